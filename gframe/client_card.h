@@ -44,8 +44,9 @@ struct CardString {
 	std::wstring text;
 	std::wstring desc[16];
 };
-typedef std::unordered_map<unsigned int, CardDataC>::const_iterator code_pointer;
+typedef const CardDataC* code_pointer;
 
+#ifndef YGOPRO_SERVER_MODE
 class ClientCard {
 public:
 	irr::core::matrix4 mTransform;
@@ -120,6 +121,7 @@ public:
 	static bool deck_sort_def(code_pointer l1, code_pointer l2);
 	static bool deck_sort_name(code_pointer l1, code_pointer l2);
 };
+#endif //YGOPRO_SERVER_MODE
 
 }
 
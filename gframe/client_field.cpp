@@ -1068,6 +1068,8 @@ void ClientField::GetCardLocation(ClientCard* pcard, irr::core::vector3df* t, ir
 	}
 }
 void ClientField::MoveCard(ClientCard * pcard, int frame) {
+	if(mainGame->dInfo.isReplay && mainGame->replaySpeed > 1)
+		frame = std::max(1, frame / mainGame->replaySpeed);
 	irr::core::vector3df trans = pcard->curPos;
 	irr::core::vector3df rot = pcard->curRot;
 	GetCardLocation(pcard, &trans, &rot);
@@ -1098,6 +1100,8 @@ void ClientField::MoveCard(ClientCard * pcard, int frame) {
 	pcard->aniFrame = frame;
 }
 void ClientField::FadeCard(ClientCard * pcard, int alpha, int frame) {
+	if(mainGame->dInfo.isReplay && mainGame->replaySpeed > 1)
+		frame = std::max(1, frame / mainGame->replaySpeed);
 	pcard->dAlpha = (alpha - pcard->curAlpha) / frame;
 	pcard->is_fading = true;
 	pcard->aniFrame = frame;
@@ -1531,17 +1535,18 @@ void ClientField::UpdateDeclarableList() {
 	}
 	mainGame->lstANCard->clear();
 	ancard.clear();
-	for(auto cit = dataManager._strings.begin(); cit != dataManager._strings.end(); ++cit) {
-		if(cit->second.name.find(pname) != std::wstring::npos) {
-			auto cp = dataManager.GetCodePointer(cit->first);	//verified by _strings
+	for(size_t index = 0; index < dataManager._strings.size(); ++index) {
+		const wchar_t* name = &dataManager._namePool[dataManager._strings[index].name];
+		if(wcsstr(name, pname)) {
+			const CardDataC& data = dataManager._datas[index];
 			//datas.alias can be double card names or alias
-			if(is_declarable(cp->second, declare_opcodes)) {
-				if(pname == cit->second.name || trycode == cit->first) { //exact match or last used
-					mainGame->lstANCard->insertItem(0, cit->second.name.c_str(), -1);
-					ancard.insert(ancard.begin(), cit->first);
+			if(is_declarable(data, declare_opcodes)) {
+				if(!wcscmp(pname, name) || trycode == data.code) { //exact match or last used
+					mainGame->lstANCard->insertItem(0, name, -1);
+					ancard.insert(ancard.begin(), data.code);
 				} else {
-					mainGame->lstANCard->addItem(cit->second.name.c_str());
-					ancard.push_back(cit->first);
+					mainGame->lstANCard->addItem(name);
+					ancard.push_back(data.code);
 				}
 			}
 		}
@@ -3,6 +3,7 @@
 
 #include "config.h"
 #include "../ocgcore/mtrandom.h"
+#include "query_cache.h"
 #include <vector>
 #include <set>
 #include <map>
@@ -46,6 +47,7 @@ public:
 	std::vector<int> select_options_index;
 	std::vector<ChainInfo> chains;
 	int extra_p_count[2];
+	QueryCache query_cache;
 
 	size_t selected_option;
 	ClientCard* attacker;
@@ -1,29 +1,142 @@
 #include "data_manager.h"
-#include "game.h"
+#include "myfilesystem.h"
+#include "script_cache.h"
 #include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 namespace ygo {
 
 const wchar_t* DataManager::unknown_string = L"???";
 wchar_t DataManager::strBuffer[4096];
-byte DataManager::scriptBuffer[0x20000];
+thread_local byte DataManager::scriptBuffer[0x20000];
 DataManager dataManager;
 
+static long long GetTime() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 bool DataManager::LoadDB(const char* file) {
+	return LoadDBs(std::vector<std::string>(1, file))[0];
+}
+std::vector<bool> DataManager::LoadDBs(const std::vector<std::string>& files) {
+	std::vector<CardBatch> batches(files.size());
+	std::vector<long long> times(files.size());
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		size_t i;
+		while((i = next++) < files.size()) {
+			long long start = GetTime();
+			ReadBatch(files[i].c_str(), batches[i]);
+			times[i] = GetTime() - start;
+		}
+	};
+	size_t threads = std::min<size_t>(std::thread::hardware_concurrency(), files.size());
+	std::vector<std::thread> pool;
+	for(size_t t = 1; t < threads; ++t)
+		pool.emplace_back(worker);
+	worker();
+	for(auto& th : pool)
+		th.join();
+	// merged in the order of files whichever worker finished first, so an earlier file still wins
+	long long start = GetTime();
+	std::vector<bool> loaded(files.size());
+	load_times.clear();
+	CardBatch all;
+	for(size_t i = 0; i < files.size(); ++i) {
+		loaded[i] = batches[i].error.empty();
+		CardLoadTime step;
+		step.file = files[i];
+		step.error = batches[i].error;
+		step.snapshot = batches[i].snapshot;
+		step.cards = (unsigned int)batches[i].datas.size();
+		step.time = times[i];
+		load_times.push_back(step);
+		if(loaded[i])
+			AppendBatch(all, batches[i]);
+		batches[i] = CardBatch();
+	}
+	SortCards(all);
+	MergeCards(all);
+	CardLoadTime step;
+	step.snapshot = false;
+	step.cards = (unsigned int)_datas.size();
+	step.time = GetTime() - start;
+	load_times.push_back(step);
+	return loaded;
+}
+void DataManager::ListDBs(const char* dir, std::vector<std::string>& files) {
+	std::vector<std::string> names;
+	FileSystem::TraversalDir(dir, [&names](const char* name, bool isdir) {
+		if(!isdir && strrchr(name, '.') && !mystrncasecmp(strrchr(name, '.'), ".cdb", 4))
+			names.push_back(name);
+	});
+	// the directory order differs between file systems
+	std::sort(names.begin(), names.end());
+	for(auto& name : names)
+		files.push_back(std::string(dir) + "/" + name);
+}
+void DataManager::FormatLoadTime(const CardLoadTime& step, char* buf, size_t size) {
+	if(step.file.empty())
+		snprintf(buf, size, "merged %u cards in %.1f ms", step.cards, step.time / 1000.0);
+	else if(!step.error.empty())
+		snprintf(buf, size, "%s: %s", step.file.c_str(), step.error.c_str());
+	else
+		snprintf(buf, size, "%s: %u cards from %s in %.1f ms", step.file.c_str(), step.cards, step.snapshot ? "snapshot" : "sqlite", step.time / 1000.0);
+}
+bool DataManager::ReadBatch(const char* file, CardBatch& batch) {
+	wchar_t wfile[1024];
+	BufferIO::DecodeUTF8(file, wfile);
+	wchar_t snapshot[1024];
+	myswprintf(snapshot, L"%ls.snap", wfile);
+	unsigned long long size = 0, mtime = 0;
+	bool cacheable = FileSystem::GetFileInfo(wfile, &size, &mtime);
+	if(cacheable && ReadSnapshot(snapshot, size, mtime, batch)) {
+		batch.snapshot = true;
+		return true;
+	}
+	if(!ReadDB(file, batch))
+		return false;
+	SortCards(batch);
+	if(cacheable)
+		SaveSnapshot(snapshot, size, mtime, batch);
+	return true;
+}
+#ifndef YGOPRO_SERVER_MODE
+static unsigned int AddName(std::vector<wchar_t>& pool, const char* text) {
+	if(!text || !text[0])
+		return 0;
+	unsigned int offset = (unsigned int)pool.size();
+	// UTF-8 never has fewer bytes than the decoded string has wchar_t
+	pool.resize(offset + strlen(text) + 1);
+	int len = BufferIO::DecodeUTF8(text, &pool[offset]);
+	pool.resize(offset + len + 1);
+	return offset;
+}
+static unsigned int AddText(std::vector<char>& pool, const char* text) {
+	if(!text || !text[0])
+		return 0;
+	unsigned int offset = (unsigned int)pool.size();
+	pool.insert(pool.end(), text, text + strlen(text) + 1);
+	return offset;
+}
+#endif
+bool DataManager::ReadDB(const char* file, CardBatch& batch) {
 	sqlite3* pDB;
 	if(sqlite3_open_v2(file, &pDB, SQLITE_OPEN_READONLY, 0) != SQLITE_OK)
-		return Error(pDB);
+		return Error(batch, pDB);
 	sqlite3_stmt* pStmt;
 	const char* sql = "select * from datas,texts where datas.id=texts.id";
 	if(sqlite3_prepare_v2(pDB, sql, -1, &pStmt, 0) != SQLITE_OK)
-		return Error(pDB);
+		return Error(batch, pDB);
 	CardDataC cd;
-	CardString cs;
+	CardText ct;
 	int step = 0;
 	do {
 		step = sqlite3_step(pStmt);
 		if(step == SQLITE_BUSY || step == SQLITE_ERROR || step == SQLITE_MISUSE)
-			return Error(pDB, pStmt);
+			return Error(batch, pDB, pStmt);
 		else if(step == SQLITE_ROW) {
 			cd.code = sqlite3_column_int(pStmt, 0);
 			cd.ot = sqlite3_column_int(pStmt, 1);
@@ -44,28 +157,182 @@ bool DataManager::LoadDB(const char* file) {
 			cd.race = sqlite3_column_int(pStmt, 8);
 			cd.attribute = sqlite3_column_int(pStmt, 9);
 			cd.category = sqlite3_column_int(pStmt, 10);
-			_datas.insert(std::make_pair(cd.code, cd));
-			if(const char* text = (const char*)sqlite3_column_text(pStmt, 12)) {
-				BufferIO::DecodeUTF8(text, strBuffer);
-				cs.name = strBuffer;
-			}
-			if(const char* text = (const char*)sqlite3_column_text(pStmt, 13)) {
-				BufferIO::DecodeUTF8(text, strBuffer);
-				cs.text = strBuffer;
-			}
-			for(int i = 0; i < 16; ++i) {
-				if(const char* text = (const char*)sqlite3_column_text(pStmt, i + 14)) {
-					BufferIO::DecodeUTF8(text, strBuffer);
-					cs.desc[i] = strBuffer;
-				}
-			}
-			_strings.emplace(cd.code, cs);
+			batch.datas.push_back(cd);
+			memset(&ct, 0, sizeof(ct));
+#ifndef YGOPRO_SERVER_MODE
+			ct.name = AddName(batch.names, (const char*)sqlite3_column_text(pStmt, 12));
+			ct.text = AddText(batch.strings, (const char*)sqlite3_column_text(pStmt, 13));
+			for(int i = 0; i < 16; ++i)
+				ct.desc[i] = AddText(batch.strings, (const char*)sqlite3_column_text(pStmt, i + 14));
+#endif
+			batch.texts.push_back(ct);
 		}
 	} while(step != SQLITE_DONE);
 	sqlite3_finalize(pStmt);
 	sqlite3_close(pDB);
 	return true;
 }
+bool DataManager::ReadSnapshot(const wchar_t* file, unsigned long long size, unsigned long long mtime, CardBatch& batch) {
+	size_t map_size;
+	const unsigned char* data = FileSystem::MapFile(file, &map_size);
+	if(!data)
+		return false;
+	const CardSnapshotHeader* header = (const CardSnapshotHeader*)data;
+	const size_t entry_size = sizeof(CardDataC) + sizeof(CardText);
+	bool valid = map_size >= sizeof(CardSnapshotHeader) && header->id == CARD_SNAPSHOT_ID && header->version == CARD_SNAPSHOT_VERSION
+		&& header->data_size == sizeof(CardDataC) && header->char_size == sizeof(wchar_t)
+		&& header->source_size == size && header->source_mtime == mtime
+		&& header->count <= map_size / entry_size && header->name_size > 0 && header->name_size <= map_size / sizeof(wchar_t)
+		&& header->text_size > 0 && header->text_size <= map_size
+		&& map_size == sizeof(CardSnapshotHeader) + header->count * entry_size + header->name_size * sizeof(wchar_t) + header->text_size;
+#ifndef YGOPRO_SERVER_MODE
+	valid = valid && (header->flag & CARD_SNAPSHOT_TEXTS);
+#endif
+	if(!valid) {
+		FileSystem::UnmapFile(data, map_size);
+		return false;
+	}
+	const CardDataC* datas = (const CardDataC*)(data + sizeof(CardSnapshotHeader));
+	const CardText* texts = (const CardText*)(datas + header->count);
+	const wchar_t* names = (const wchar_t*)(texts + header->count);
+	const char* strings = (const char*)(names + header->name_size);
+	// every offset must point at a string ending inside its pool
+	valid = names[header->name_size - 1] == 0 && strings[header->text_size - 1] == 0;
+	for(unsigned int i = 0; i < header->count && valid; ++i) {
+		valid = texts[i].name < header->name_size && texts[i].text < header->text_size;
+		for(int j = 0; j < 16 && valid; ++j)
+			valid = texts[i].desc[j] < header->text_size;
+	}
+	if(!valid) {
+		FileSystem::UnmapFile(data, map_size);
+		return false;
+	}
+	// written by SaveSnapshot, so already sorted without duplicates
+	batch.datas.assign(datas, datas + header->count);
+#ifdef YGOPRO_SERVER_MODE
+	batch.texts.resize(header->count);
+	memset(batch.texts.data(), 0, header->count * sizeof(CardText));
+#else
+	batch.texts.assign(texts, texts + header->count);
+	batch.names.assign(names, names + header->name_size);
+	batch.strings.assign(strings, strings + header->text_size);
+#endif
+	FileSystem::UnmapFile(data, map_size);
+	return true;
+}
+void DataManager::SaveSnapshot(const wchar_t* file, unsigned long long size, unsigned long long mtime, const CardBatch& batch) {
+	CardSnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	header.id = CARD_SNAPSHOT_ID;
+	header.version = CARD_SNAPSHOT_VERSION;
+	header.data_size = sizeof(CardDataC);
+	header.char_size = sizeof(wchar_t);
+	header.source_size = size;
+	header.source_mtime = mtime;
+	header.count = (unsigned int)batch.datas.size();
+#ifndef YGOPRO_SERVER_MODE
+	header.flag = CARD_SNAPSHOT_TEXTS;
+#endif
+	header.name_size = (unsigned int)batch.names.size();
+	header.text_size = (unsigned int)batch.strings.size();
+	FILE* fp;
+#ifdef _WIN32
+	fp = _wfopen(file, L"wb");
+#else
+	char fname[1024];
+	BufferIO::EncodeUTF8(file, fname);
+	fp = fopen(fname, "wb");
+#endif
+	// a read only folder only costs the SQLite load next time
+	if(!fp)
+		return;
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(batch.datas.data(), sizeof(CardDataC), batch.datas.size(), fp);
+	fwrite(batch.texts.data(), sizeof(CardText), batch.texts.size(), fp);
+	fwrite(batch.names.data(), sizeof(wchar_t), batch.names.size(), fp);
+	fwrite(batch.strings.data(), 1, batch.strings.size(), fp);
+	fclose(fp);
+}
+void DataManager::SortCards(CardBatch& batch) {
+	std::vector<unsigned int> order(batch.datas.size());
+	for(size_t i = 0; i < order.size(); ++i)
+		order[i] = (unsigned int)i;
+	const std::vector<CardDataC>& datas = batch.datas;
+	std::stable_sort(order.begin(), order.end(), [&datas](unsigned int a, unsigned int b) {
+		return datas[a].code < datas[b].code;
+	});
+	std::vector<CardDataC> sorted_datas;
+	std::vector<CardText> sorted_texts;
+	sorted_datas.reserve(datas.size());
+	sorted_texts.reserve(datas.size());
+	for(size_t i = 0; i < order.size(); ++i) {
+		// the first row of a code wins
+		if(i > 0 && datas[order[i]].code == datas[order[i - 1]].code)
+			continue;
+		sorted_datas.push_back(datas[order[i]]);
+		sorted_texts.push_back(batch.texts[order[i]]);
+	}
+	batch.datas.swap(sorted_datas);
+	batch.texts.swap(sorted_texts);
+}
+// appends the pools of a batch without their leading empty string, moving the offsets of its cards along
+static void AppendPools(std::vector<wchar_t>& names, std::vector<char>& strings, const CardBatch& batch, std::vector<CardText>& texts) {
+	unsigned int name_base = (unsigned int)names.size() - 1;
+	unsigned int text_base = (unsigned int)strings.size() - 1;
+	names.insert(names.end(), batch.names.begin() + 1, batch.names.end());
+	strings.insert(strings.end(), batch.strings.begin() + 1, batch.strings.end());
+	for(auto& ct : texts) {
+		if(ct.name)
+			ct.name += name_base;
+		if(ct.text)
+			ct.text += text_base;
+		for(int i = 0; i < 16; ++i)
+			if(ct.desc[i])
+				ct.desc[i] += text_base;
+	}
+}
+void DataManager::AppendBatch(CardBatch& batch, const CardBatch& other) {
+	std::vector<CardText> texts(other.texts);
+	AppendPools(batch.names, batch.strings, other, texts);
+	batch.datas.insert(batch.datas.end(), other.datas.begin(), other.datas.end());
+	batch.texts.insert(batch.texts.end(), texts.begin(), texts.end());
+}
+void DataManager::MergeCards(CardBatch& batch) {
+	AppendPools(_namePool, _textPool, batch, batch.texts);
+	std::vector<unsigned int> codes;
+	std::vector<CardDataC> merged_datas;
+	std::vector<CardText> merged_texts;
+	size_t total = _codes.size() + batch.datas.size();
+	codes.reserve(total);
+	merged_datas.reserve(total);
+	merged_texts.reserve(total);
+	size_t i = 0, j = 0;
+	while(i < _codes.size() || j < batch.datas.size()) {
+		if(j == batch.datas.size() || (i < _codes.size() && _codes[i] <= batch.datas[j].code)) {
+			// a card loaded before wins over the same code in a later database
+			if(j < batch.datas.size() && _codes[i] == batch.datas[j].code)
+				++j;
+			codes.push_back(_codes[i]);
+			merged_datas.push_back(_datas[i]);
+			merged_texts.push_back(_strings[i]);
+			++i;
+		} else {
+			codes.push_back(batch.datas[j].code);
+			merged_datas.push_back(batch.datas[j]);
+			merged_texts.push_back(batch.texts[j]);
+			++j;
+		}
+	}
+	_codes.swap(codes);
+	_datas.swap(merged_datas);
+	_strings.swap(merged_texts);
+}
+int DataManager::FindCard(unsigned int code) const {
+	auto it = std::lower_bound(_codes.begin(), _codes.end(), code);
+	if(it == _codes.end() || *it != code)
+		return -1;
+	return (int)(it - _codes.begin());
+}
 bool DataManager::LoadStrings(const char* file) {
 	FILE* fp = fopen(file, "r");
 	if(!fp)
@@ -100,61 +367,76 @@ bool DataManager::LoadStrings(const char* file) {
 		myswprintf(numStrings[i], L"%d", i);
 	return true;
 }
-bool DataManager::Error(sqlite3* pDB, sqlite3_stmt* pStmt) {
-	BufferIO::DecodeUTF8(sqlite3_errmsg(pDB), strBuffer);
+bool DataManager::Error(CardBatch& batch, sqlite3* pDB, sqlite3_stmt* pStmt) {
+	batch.error = sqlite3_errmsg(pDB);
 	if(pStmt)
 		sqlite3_finalize(pStmt);
 	sqlite3_close(pDB);
 	return false;
 }
 bool DataManager::GetData(int code, CardData* pData) {
-	auto cdit = _datas.find(code);
-	if(cdit == _datas.end())
+	int index = FindCard(code);
+	if(index < 0)
 		return false;
 	if(pData)
-		*pData = *((CardData*)&cdit->second);
+		*pData = *((CardData*)&_datas[index]);
 	return true;
 }
 code_pointer DataManager::GetCodePointer(int code) {
-	return _datas.find(code);
+	int index = FindCard(code);
+	if(index < 0)
+		return 0;
+	return &_datas[index];
+}
+const wchar_t* DataManager::DecodeText(unsigned int offset) {
+	_textMutex.lock();
+	auto tit = _textCache.find(offset);
+	if(tit == _textCache.end()) {
+		const char* text = &_textPool[offset];
+		std::wstring str(strlen(text) + 1, 0);
+		str.resize(BufferIO::DecodeUTF8(text, &str[0]));
+		tit = _textCache.emplace(offset, std::move(str)).first;
+	}
+	// a rehash keeps the nodes, so the string stays where it is
+	const wchar_t* result = tit->second.c_str();
+	_textMutex.unlock();
+	return result;
 }
 bool DataManager::GetString(int code, CardString* pStr) {
-	auto csit = _strings.find(code);
-	if(csit == _strings.end()) {
+	int index = FindCard(code);
+	if(index < 0) {
 		pStr->name = unknown_string;
 		pStr->text = unknown_string;
 		return false;
 	}
-	*pStr = csit->second;
+	const CardText& ct = _strings[index];
+	pStr->name = &_namePool[ct.name];
+	pStr->text = ct.text ? DecodeText(ct.text) : L"";
+	for(int i = 0; i < 16; ++i)
+		pStr->desc[i] = ct.desc[i] ? DecodeText(ct.desc[i]) : L"";
 	return true;
 }
 const wchar_t* DataManager::GetName(int code) {
-	auto csit = _strings.find(code);
-	if(csit == _strings.end())
+	int index = FindCard(code);
+	if(index < 0 || !_strings[index].name)
 		return unknown_string;
-	if(!csit->second.name.empty())
-		return csit->second.name.c_str();
-	return unknown_string;
+	return &_namePool[_strings[index].name];
 }
 const wchar_t* DataManager::GetText(int code) {
-	auto csit = _strings.find(code);
-	if(csit == _strings.end())
+	int index = FindCard(code);
+	if(index < 0 || !_strings[index].text)
 		return unknown_string;
-	if(!csit->second.text.empty())
-		return csit->second.text.c_str();
-	return unknown_string;
+	return DecodeText(_strings[index].text);
 }
 const wchar_t* DataManager::GetDesc(unsigned int strCode) {
 	if(strCode < 10000u)
 		return GetSysString(strCode);
 	unsigned int code = (strCode >> 4) & 0x0fffffff;
 	unsigned int offset = strCode & 0xf;
-	auto csit = _strings.find(code);
-	if(csit == _strings.end())
+	int index = FindCard(code);
+	if(index < 0 || !_strings[index].desc[offset])
 		return unknown_string;
-	if(!csit->second.desc[offset].empty())
-		return csit->second.desc[offset].c_str();
-	return unknown_string;
+	return DecodeText(_strings[index].desc[offset]);
 }
 const wchar_t* DataManager::GetSysString(int code) {
 	if(code < 0 || code >= 2048)
@@ -315,13 +597,15 @@ byte* DataManager::ScriptReaderEx(const char* script_name, int* slen) {
 	// default script name: ./script/c%d.lua
 	char first[256];
 	char second[256];
-	if(mainGame->gameConf.prefer_expansion_script) {
+	if(dataManager.prefer_expansion_script) {
 		sprintf(first, "expansions/%s", script_name + 2);
 		sprintf(second, "%s", script_name + 2);
 	} else {
 		sprintf(first, "%s", script_name + 2);
 		sprintf(second, "expansions/%s", script_name + 2);
 	}
+	if(ScriptCache::enabled)
+		return ScriptCache::Read(script_name, first, second, slen);
 	if(ScriptReader(first, slen))
 		return scriptBuffer;
 	else
@@ -5,15 +5,76 @@
 #include "sqlite3.h"
 #include "client_card.h"
 #include <unordered_map>
+#include <vector>
+#include <string>
+#include <mutex>
 
 namespace ygo {
 
+#define CARD_SNAPSHOT_ID		0x70616e73
+#define CARD_SNAPSHOT_VERSION	2
+// the snapshot has the names and texts, the server writes it without
+#define CARD_SNAPSHOT_TEXTS		0x1
+
+// A snapshot (name.cdb.snap) is the header, then CardDataC[count] sorted by code, CardText[count],
+// the names, wchar_t[name_size], and the texts, UTF-8 char[text_size], both starting with an empty string.
+// It is valid while the database keeps its size and mtime.
+struct CardSnapshotHeader {
+	unsigned int id;
+	unsigned int version;
+	unsigned int data_size;
+	unsigned int char_size;
+	unsigned long long source_size;
+	unsigned long long source_mtime;
+	unsigned int count;
+	unsigned int flag;
+	unsigned int name_size;
+	unsigned int text_size;
+};
+// offsets of the strings of a card, the name in the name pool and the rest in the UTF-8 text pool, 0 when empty
+struct CardText {
+	unsigned int name;
+	unsigned int text;
+	unsigned int desc[16];
+};
+// the cards of one database, sorted by code after SortCards
+struct CardBatch {
+	std::vector<CardDataC> datas;
+	std::vector<CardText> texts;
+	std::vector<wchar_t> names;
+	std::vector<char> strings;
+	bool snapshot;
+	std::string error;
+
+	CardBatch(): names(1, 0), strings(1, 0), snapshot(false) {}
+};
+// one step of the last LoadDBs for the startup log, the file is empty for the merge
+struct CardLoadTime {
+	std::string file;
+	std::string error;
+	bool snapshot;
+	unsigned int cards;
+	long long time;
+};
+
 class DataManager {
 public:
-	DataManager(): _datas(8192), _strings(8192) {}
+	DataManager(): _namePool(1, 0), _textPool(1, 0), prefer_expansion_script(false) {}
 	bool LoadDB(const char* file);
+	std::vector<bool> LoadDBs(const std::vector<std::string>& files);
+	static void ListDBs(const char* dir, std::vector<std::string>& files);
+	static void FormatLoadTime(const CardLoadTime& step, char* buf, size_t size);
+	static bool ReadBatch(const char* file, CardBatch& batch);
+	static bool ReadDB(const char* file, CardBatch& batch);
+	static bool ReadSnapshot(const wchar_t* file, unsigned long long size, unsigned long long mtime, CardBatch& batch);
+	static void SaveSnapshot(const wchar_t* file, unsigned long long size, unsigned long long mtime, const CardBatch& batch);
+	static void SortCards(CardBatch& batch);
+	static void AppendBatch(CardBatch& batch, const CardBatch& other);
+	void MergeCards(CardBatch& batch);
+	int FindCard(unsigned int code) const;
+	const wchar_t* DecodeText(unsigned int offset);
 	bool LoadStrings(const char* file);
-	bool Error(sqlite3* pDB, sqlite3_stmt* pStmt = 0);
+	static bool Error(CardBatch& batch, sqlite3* pDB, sqlite3_stmt* pStmt = 0);
 	bool GetData(int code, CardData* pData);
 	code_pointer GetCodePointer(int code);
 	bool GetString(int code, CardString* pStr);
@@ -33,8 +94,17 @@ public:
 	const wchar_t* FormatSetName(unsigned long long setcode);
 	const wchar_t* FormatLinkMarker(int link_marker);
 
-	std::unordered_map<unsigned int, CardDataC> _datas;
-	std::unordered_map<unsigned int, CardString> _strings;
+	// the cards sorted by code, _codes is the lookup index and _datas, _strings are parallel to it.
+	// A code_pointer points into _datas and is valid until the next LoadDB.
+	std::vector<unsigned int> _codes;
+	std::vector<CardDataC> _datas;
+	std::vector<CardText> _strings;
+	std::vector<wchar_t> _namePool;
+	// texts and descs stay UTF-8 until they are shown, _textCache has the decoded ones by offset
+	std::vector<char> _textPool;
+	std::unordered_map<unsigned int, std::wstring> _textCache;
+	std::mutex _textMutex;
+	std::vector<CardLoadTime> load_times;
 	std::unordered_map<unsigned int, std::wstring> _counterStrings;
 	std::unordered_map<unsigned int, std::wstring> _victoryStrings;
 	std::unordered_map<unsigned int, std::wstring> _setnameStrings;
@@ -47,9 +117,10 @@ public:
 	wchar_t tpBuffer[128];
 	wchar_t scBuffer[128];
 	wchar_t lmBuffer[32];
+	bool prefer_expansion_script;
 
 	static wchar_t strBuffer[4096];
-	static byte scriptBuffer[0x20000];
+	static thread_local byte scriptBuffer[0x20000];
 	static const wchar_t* unknown_string;
 	static int CardReader(int, void*);
 	static byte* ScriptReaderEx(const char* script_name, int* slen);
@@ -42,9 +42,9 @@ static int parse_filter(const wchar_t* pstr, unsigned int* type) {
 static bool check_set_code(const CardDataC& data, int set_code) {
 	unsigned long long sc = data.setcode;
 	if (data.alias) {
-		auto aptr = dataManager._datas.find(data.alias);
-		if (aptr != dataManager._datas.end())
-			sc = aptr->second.setcode;
+		auto aptr = dataManager.GetCodePointer(data.alias);
+		if (aptr)
+			sc = aptr->setcode;
 	}
 	bool res = false;
 	int settype = set_code & 0xfff;
@@ -248,11 +248,11 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 				BufferIO::WriteInt32(pdeck, deckManager.current_deck.main.size() + deckManager.current_deck.extra.size());
 				BufferIO::WriteInt32(pdeck, deckManager.current_deck.side.size());
 				for(size_t i = 0; i < deckManager.current_deck.main.size(); ++i)
-					BufferIO::WriteInt32(pdeck, deckManager.current_deck.main[i]->first);
+					BufferIO::WriteInt32(pdeck, deckManager.current_deck.main[i]->code);
 				for(size_t i = 0; i < deckManager.current_deck.extra.size(); ++i)
-					BufferIO::WriteInt32(pdeck, deckManager.current_deck.extra[i]->first);
+					BufferIO::WriteInt32(pdeck, deckManager.current_deck.extra[i]->code);
 				for(size_t i = 0; i < deckManager.current_deck.side.size(); ++i)
-					BufferIO::WriteInt32(pdeck, deckManager.current_deck.side[i]->first);
+					BufferIO::WriteInt32(pdeck, deckManager.current_deck.side[i]->code);
 				DuelClient::SendBufferToServer(CTOS_UPDATE_DECK, deckbuf, pdeck - deckbuf);
 				break;
 			}
@@ -552,7 +552,7 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 			dragx = event.MouseInput.X;
 			dragy = event.MouseInput.Y;
 			draging_pointer = dataManager.GetCodePointer(hovered_code);
-			if(draging_pointer == dataManager._datas.end())
+			if(!draging_pointer)
 				break;
 			if(hovered_pos == 4) {
 				if(!check_limit(draging_pointer))
@@ -592,7 +592,7 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 				if(hovered_pos == 0 || hovered_seq == -1)
 					break;
 				auto pointer = dataManager.GetCodePointer(hovered_code);
-				if(pointer == dataManager._datas.end())
+				if(!pointer)
 					break;
 				if(hovered_pos == 1) {
 					if(push_side(pointer))
@@ -619,7 +619,7 @@ bool DeckBuilder::OnEvent(const irr::SEvent& event) {
 					pop_side(hovered_seq);
 				} else {
 					auto pointer = dataManager.GetCodePointer(hovered_code);
-					if(pointer == dataManager._datas.end())
+					if(!pointer)
 						break;
 					if(!check_limit(pointer))
 						break;
@@ -738,7 +738,7 @@ void DeckBuilder::GetHoveredCard() {
 				hovered_seq = -1;
 				hovered_code = 0;
 			} else {
-				hovered_code = deckManager.current_deck.main[hovered_seq]->first;
+				hovered_code = deckManager.current_deck.main[hovered_seq]->code;
 			}
 		} else if(y >= 466 && y <= 530) {
 			int lx = deckManager.current_deck.extra.size();
@@ -753,7 +753,7 @@ void DeckBuilder::GetHoveredCard() {
 				hovered_seq = -1;
 				hovered_code = 0;
 			} else {
-				hovered_code = deckManager.current_deck.extra[hovered_seq]->first;
+				hovered_code = deckManager.current_deck.extra[hovered_seq]->code;
 				if(x >= 772)
 					is_lastcard = 1;
 			}
@@ -770,7 +770,7 @@ void DeckBuilder::GetHoveredCard() {
 				hovered_seq = -1;
 				hovered_code = 0;
 			} else {
-				hovered_code = deckManager.current_deck.side[hovered_seq]->first;
+				hovered_code = deckManager.current_deck.side[hovered_seq]->code;
 				if(x >= 772)
 					is_lastcard = 1;
 			}
@@ -783,7 +783,7 @@ void DeckBuilder::GetHoveredCard() {
 			hovered_seq = -1;
 			hovered_code = 0;
 		} else {
-			hovered_code = results[pos]->first;
+			hovered_code = results[pos]->code;
 		}
 	}
 	if(is_draging) {
@@ -885,10 +885,11 @@ void DeckBuilder::FilterCards() {
 			query_elements.push_back(element);
 		}
 	}
-	auto strpointer = dataManager._strings.begin();
-	for(code_pointer ptr = dataManager._datas.begin(); ptr != dataManager._datas.end(); ++ptr, ++strpointer) {
-		const CardDataC& data = ptr->second;
-		const CardString& text = strpointer->second;
+	for(size_t index = 0; index < dataManager._datas.size(); ++index) {
+		code_pointer ptr = &dataManager._datas[index];
+		const CardDataC& data = *ptr;
+		const CardText& text = dataManager._strings[index];
+		const wchar_t* name = &dataManager._namePool[text.name];
 		if(data.type & TYPE_TOKEN)
 			continue;
 		switch(filter_type) {
@@ -947,7 +948,7 @@ void DeckBuilder::FilterCards() {
 		if(filter_marks && (data.link_marker & filter_marks)!= filter_marks)
 			continue;
 		if(filter_lm) {
-			if(filter_lm <= 3 && (!filterList->count(ptr->first) || (*filterList).at(ptr->first) != filter_lm - 1))
+			if(filter_lm <= 3 && (!filterList->count(ptr->code) || (*filterList).at(ptr->code) != filter_lm - 1))
 				continue;
 			if(filter_lm == 4 && data.ot != 1)
 				continue;
@@ -964,15 +965,15 @@ void DeckBuilder::FilterCards() {
 		for (auto elements_iterator = query_elements.begin(); elements_iterator != query_elements.end(); ++elements_iterator) {
 			bool match = false;
 			if (elements_iterator->type == element_t::type_t::name) {
-				match = CardNameContains(text.name.c_str(), elements_iterator->keyword.c_str());
+				match = CardNameContains(name, elements_iterator->keyword.c_str());
 			} else if (elements_iterator->type == element_t::type_t::setcode) {
 				match = elements_iterator->setcode && check_set_code(data, elements_iterator->setcode);
 			} else {
 				int trycode = BufferIO::GetVal(elements_iterator->keyword.c_str());
 				bool tryresult = dataManager.GetData(trycode, 0);
 				if(!tryresult) {
-					match = CardNameContains(text.name.c_str(), elements_iterator->keyword.c_str())
-						|| text.text.find(elements_iterator->keyword) != std::wstring::npos
+					match = CardNameContains(name, elements_iterator->keyword.c_str())
+						|| (text.text && wcsstr(dataManager.DecodeText(text.text), elements_iterator->keyword.c_str()))
 						|| (elements_iterator->setcode && check_set_code(data, elements_iterator->setcode));
 				} else {
 					match = data.code == trycode || data.alias == trycode;
@@ -1041,7 +1042,7 @@ void DeckBuilder::SortList() {
 	auto left = results.begin();
 	const wchar_t* pstr = mainGame->ebCardName->getText();
 	for(auto it = results.begin(); it != results.end(); ++it) {
-		if(wcscmp(pstr, dataManager.GetName((*it)->first)) == 0) {
+		if(wcscmp(pstr, dataManager.GetName((*it)->code)) == 0) {
 			std::iter_swap(left, it);
 			++left;
 		}
@@ -1108,7 +1109,7 @@ bool DeckBuilder::CardNameContains(const wchar_t *haystack, const wchar_t *needl
 	return false;
 }
 bool DeckBuilder::push_main(code_pointer pointer, int seq) {
-	if(pointer->second.type & (TYPE_FUSION | TYPE_SYNCHRO | TYPE_XYZ | TYPE_LINK))
+	if(pointer->type & (TYPE_FUSION | TYPE_SYNCHRO | TYPE_XYZ | TYPE_LINK))
 		return false;
 	auto& container = deckManager.current_deck.main;
 	int maxc = mainGame->is_siding ? 64 : 60;
@@ -1123,7 +1124,7 @@ bool DeckBuilder::push_main(code_pointer pointer, int seq) {
 	return true;
 }
 bool DeckBuilder::push_extra(code_pointer pointer, int seq) {
-	if(!(pointer->second.type & (TYPE_FUSION | TYPE_SYNCHRO | TYPE_XYZ | TYPE_LINK)))
+	if(!(pointer->type & (TYPE_FUSION | TYPE_SYNCHRO | TYPE_XYZ | TYPE_LINK)))
 		return false;
 	auto& container = deckManager.current_deck.extra;
 	int maxc = mainGame->is_siding ? 20 : 15;
@@ -1169,27 +1170,27 @@ void DeckBuilder::pop_side(int seq) {
 	GetHoveredCard();
 }
 bool DeckBuilder::check_limit(code_pointer pointer) {
-	unsigned int limitcode = pointer->second.alias ? pointer->second.alias : pointer->first;
+	unsigned int limitcode = pointer->alias ? pointer->alias : pointer->code;
 	int limit = 3;
 	auto flit = filterList->find(limitcode);
 	if(flit != filterList->end())
 		limit = flit->second;
 	for(auto it = deckManager.current_deck.main.begin(); it != deckManager.current_deck.main.end(); ++it) {
-		if((*it)->first == limitcode || (*it)->second.alias == limitcode)
+		if((*it)->code == limitcode || (*it)->alias == limitcode)
 			limit--;
-		if((*it)->second.ot == 5 && (*it)->second.category == 1 && pointer->second.ot == 5 && pointer->second.category == 1)
+		if((*it)->ot == 5 && (*it)->category == 1 && pointer->ot == 5 && pointer->category == 1)
 			return false;
 	}
 	for(auto it = deckManager.current_deck.extra.begin(); it != deckManager.current_deck.extra.end(); ++it) {
-		if((*it)->first == limitcode || (*it)->second.alias == limitcode)
+		if((*it)->code == limitcode || (*it)->alias == limitcode)
 			limit--;
-		if ((*it)->second.ot == 5 && (*it)->second.category == 1 && pointer->second.ot == 5 && pointer->second.category == 1)
+		if ((*it)->ot == 5 && (*it)->category == 1 && pointer->ot == 5 && pointer->category == 1)
 			return false;
 	}
 	for(auto it = deckManager.current_deck.side.begin(); it != deckManager.current_deck.side.end(); ++it) {
-		if((*it)->first == limitcode || (*it)->second.alias == limitcode)
+		if((*it)->code == limitcode || (*it)->alias == limitcode)
 			limit--;
-		if ((*it)->second.ot == 5 && (*it)->second.category == 1 && pointer->second.ot == 5 && pointer->second.category == 1)
+		if ((*it)->ot == 5 && (*it)->category == 1 && pointer->ot == 5 && pointer->category == 1)
 			return false;
 	}
 	return limit > 0;
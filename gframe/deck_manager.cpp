@@ -1,7 +1,6 @@
 #include "deck_manager.h"
 #include "data_manager.h"
 #include "network.h"
-#include "game.h"
 
 namespace ygo {
 
@@ -86,50 +85,50 @@ int DeckManager::CheckDeck(Deck& deck, int lfhash, bool allow_ocg, bool allow_tc
 
 	for(size_t i = 0; i < deck.main.size(); ++i) {
 		code_pointer cit = deck.main[i];
-		if(!allow_ocg && (cit->second.ot == 0x1))
-			return (DECKERROR_OCGONLY << 28) + cit->first;
-		if(!allow_tcg && (cit->second.ot == 0x2))
-			return (DECKERROR_TCGONLY << 28) + cit->first;
-		if(cit->second.type & (TYPE_FUSION | TYPE_SYNCHRO | TYPE_XYZ | TYPE_TOKEN | TYPE_LINK))
+		if(!allow_ocg && (cit->ot == 0x1))
+			return (DECKERROR_OCGONLY << 28) + cit->code;
+		if(!allow_tcg && (cit->ot == 0x2))
+			return (DECKERROR_TCGONLY << 28) + cit->code;
+		if(cit->type & (TYPE_FUSION | TYPE_SYNCHRO | TYPE_XYZ | TYPE_TOKEN | TYPE_LINK))
 			return (DECKERROR_EXTRACOUNT << 28);
-		int code = cit->second.alias ? cit->second.alias : cit->first;
+		int code = cit->alias ? cit->alias : cit->code;
 		ccount[code]++;
 		dc = ccount[code];
 		if(dc > 3)
-			return (DECKERROR_CARDCOUNT << 28) + cit->first;
+			return (DECKERROR_CARDCOUNT << 28) + cit->code;
 		auto it = list->find(code);
 		if(it != list->end() && dc > it->second)
-			return (DECKERROR_LFLIST << 28) + cit->first;
+			return (DECKERROR_LFLIST << 28) + cit->code;
 	}
 	for(size_t i = 0; i < deck.extra.size(); ++i) {
 		code_pointer cit = deck.extra[i];
-		if(!allow_ocg && (cit->second.ot == 0x1))
-			return (DECKERROR_OCGONLY << 28) + cit->first;
-		if(!allow_tcg && (cit->second.ot == 0x2))
-			return (DECKERROR_TCGONLY << 28) + cit->first;
-		int code = cit->second.alias ? cit->second.alias : cit->first;
+		if(!allow_ocg && (cit->ot == 0x1))
+			return (DECKERROR_OCGONLY << 28) + cit->code;
+		if(!allow_tcg && (cit->ot == 0x2))
+			return (DECKERROR_TCGONLY << 28) + cit->code;
+		int code = cit->alias ? cit->alias : cit->code;
 		ccount[code]++;
 		dc = ccount[code];
 		if(dc > 3)
-			return (DECKERROR_CARDCOUNT << 28) + cit->first;
+			return (DECKERROR_CARDCOUNT << 28) + cit->code;
 		auto it = list->find(code);
 		if(it != list->end() && dc > it->second)
-			return (DECKERROR_LFLIST << 28) + cit->first;
+			return (DECKERROR_LFLIST << 28) + cit->code;
 	}
 	for(size_t i = 0; i < deck.side.size(); ++i) {
 		code_pointer cit = deck.side[i];
-		if(!allow_ocg && (cit->second.ot == 0x1))
-			return (DECKERROR_OCGONLY << 28) + cit->first;
-		if(!allow_tcg && (cit->second.ot == 0x2))
-			return (DECKERROR_TCGONLY << 28) + cit->first;
-		int code = cit->second.alias ? cit->second.alias : cit->first;
+		if(!allow_ocg && (cit->ot == 0x1))
+			return (DECKERROR_OCGONLY << 28) + cit->code;
+		if(!allow_tcg && (cit->ot == 0x2))
+			return (DECKERROR_TCGONLY << 28) + cit->code;
+		int code = cit->alias ? cit->alias : cit->code;
 		ccount[code]++;
 		dc = ccount[code];
 		if(dc > 3)
-			return (DECKERROR_CARDCOUNT << 28) + cit->first;
+			return (DECKERROR_CARDCOUNT << 28) + cit->code;
 		auto it = list->find(code);
 		if(it != list->end() && dc > it->second)
-			return (DECKERROR_LFLIST << 28) + cit->first;
+			return (DECKERROR_LFLIST << 28) + cit->code;
 	}
 	return 0;
 }
@@ -171,21 +170,21 @@ bool DeckManager::LoadSide(Deck& deck, int* dbuf, int mainc, int sidec) {
 	std::unordered_map<int, int> pcount;
 	std::unordered_map<int, int> ncount;
 	for(size_t i = 0; i < deck.main.size(); ++i)
-		pcount[deck.main[i]->first]++;
+		pcount[deck.main[i]->code]++;
 	for(size_t i = 0; i < deck.extra.size(); ++i)
-		pcount[deck.extra[i]->first]++;
+		pcount[deck.extra[i]->code]++;
 	for(size_t i = 0; i < deck.side.size(); ++i)
-		pcount[deck.side[i]->first]++;
+		pcount[deck.side[i]->code]++;
 	Deck ndeck;
 	LoadDeck(ndeck, dbuf, mainc, sidec);
 	if(ndeck.main.size() != deck.main.size() || ndeck.extra.size() != deck.extra.size())
 		return false;
 	for(size_t i = 0; i < ndeck.main.size(); ++i)
-		ncount[ndeck.main[i]->first]++;
+		ncount[ndeck.main[i]->code]++;
 	for(size_t i = 0; i < ndeck.extra.size(); ++i)
-		ncount[ndeck.extra[i]->first]++;
+		ncount[ndeck.extra[i]->code]++;
 	for(size_t i = 0; i < ndeck.side.size(); ++i)
-		ncount[ndeck.side[i]->first]++;
+		ncount[ndeck.side[i]->code]++;
 	for(auto cdit = ncount.begin(); cdit != ncount.end(); ++cdit)
 		if(cdit->second != pcount[cdit->first])
 			return false;
@@ -244,13 +243,13 @@ bool DeckManager::SaveDeck(Deck& deck, const wchar_t* name) {
 		return false;
 	fprintf(fp, "#created by ...\n#main\n");
 	for(size_t i = 0; i < deck.main.size(); ++i)
-		fprintf(fp, "%d\n", deck.main[i]->first);
+		fprintf(fp, "%d\n", deck.main[i]->code);
 	fprintf(fp, "#extra\n");
 	for(size_t i = 0; i < deck.extra.size(); ++i)
-		fprintf(fp, "%d\n", deck.extra[i]->first);
+		fprintf(fp, "%d\n", deck.extra[i]->code);
 	fprintf(fp, "!side\n");
 	for(size_t i = 0; i < deck.side.size(); ++i)
-		fprintf(fp, "%d\n", deck.side[i]->first);
+		fprintf(fp, "%d\n", deck.side[i]->code);
 	fclose(fp);
 	return true;
 }
@@ -1094,13 +1094,21 @@ void Game::PopupElement(irr::gui::IGUIElement * element, int hideframe) {
 	else ShowElement(element, hideframe);
 }
 void Game::WaitFrameSignal(int frame) {
+	if(dInfo.isReplay && replaySpeed > 1) {
+		// waits shorter than a frame add up, so at high speed several steps share one frame
+		replayFrames += frame;
+		frame = replayFrames / replaySpeed;
+		replayFrames %= replaySpeed;
+		if(!frame)
+			return;
+	}
 	frameSignal.Reset();
 	signalFrame = (gameConf.quick_animation && frame >= 12) ? 12 : frame;
 	frameSignal.Wait();
 }
 void Game::DrawThumb(code_pointer cp, position2di pos, const std::unordered_map<int,int>* lflist, bool drag) {
-	int code = cp->first;
-	int lcode = cp->second.alias;
+	int code = cp->code;
+	int lcode = cp->alias;
 	if(lcode == 0)
 		lcode = code;
 	irr::video::ITexture* img = imageManager.GetTextureThumb(code);
@@ -1109,10 +1117,10 @@ void Game::DrawThumb(code_pointer cp, position2di pos, const std::unordered_map<
 	dimension2d<u32> size = img->getOriginalSize();
 	driver->draw2DImage(img, mainGame->Resize(pos.X, pos.Y, pos.X + CARD_THUMB_WIDTH, pos.Y + CARD_THUMB_HEIGHT), rect<s32>(0, 0, size.Width, size.Height));
 
-	if(cp->second.ot == 5)
+	if(cp->ot == 5)
 		driver->draw2DImage(imageManager.tRush, mainGame->Resize(pos.X + 3, pos.Y + 46, pos.X + 41, pos.Y + 65), recti(0, 0, 152, 76), 0, 0, true);
 
-	if(cp->second.ot == 5 && cp->second.category == 128) {
+	if(cp->ot == 5 && cp->category == 128) {
 		driver->draw2DImage(imageManager.tLegend, mainGame->Resize(pos.X, pos.Y, pos.X + 20, pos.Y + 20), recti(0, 0, 64, 64), 0, 0, true);
 	}
 	else if(lflist->count(lcode)) {
@@ -1128,8 +1136,8 @@ void Game::DrawThumb(code_pointer cp, position2di pos, const std::unordered_map<
 			break;
 		}
 	}
-	if(mainGame->cbLimit->getSelected() >= 4 && (cp->second.ot & mainGame->gameConf.defaultOT)) {
-		switch(cp->second.ot) {
+	if(mainGame->cbLimit->getSelected() >= 4 && (cp->ot & mainGame->gameConf.defaultOT)) {
+		switch(cp->ot) {
 		case 1:
 			driver->draw2DImage(imageManager.tOT, mainGame->Resize(pos.X + 7, pos.Y + 50, pos.X + 37, pos.Y + 65), recti(0, 128, 128, 192), 0, 0, true);
 			break;
@@ -1137,8 +1145,8 @@ void Game::DrawThumb(code_pointer cp, position2di pos, const std::unordered_map<
 			driver->draw2DImage(imageManager.tOT, mainGame->Resize(pos.X + 7, pos.Y + 50, pos.X + 37, pos.Y + 65), recti(0, 192, 128, 256), 0, 0, true);
 			break;
 		}
-	} else if(mainGame->cbLimit->getSelected() >= 4 || !(cp->second.ot & mainGame->gameConf.defaultOT)) {
-		switch(cp->second.ot) {
+	} else if(mainGame->cbLimit->getSelected() >= 4 || !(cp->ot & mainGame->gameConf.defaultOT)) {
+		switch(cp->ot) {
 		case 1:
 			driver->draw2DImage(imageManager.tOT, mainGame->Resize(pos.X + 7, pos.Y + 50, pos.X + 37, pos.Y + 65), recti(0, 0, 128, 64), 0, 0, true);
 			break;
@@ -1221,61 +1229,61 @@ void Game::DrawDeckBd() {
 		if(deckBuilder.hovered_pos == 4 && deckBuilder.hovered_seq == (int)i)
 			driver->draw2DRectangle(0x80000000, mainGame->Resize(806, 164 + i * 66, 1019, 230 + i * 66));
 		DrawThumb(ptr, position2di(810, 165 + i * 66), deckBuilder.filterList);
-		if(ptr->second.type & TYPE_MONSTER) {
-			myswprintf(textBuffer, L"%ls", dataManager.GetName(ptr->first));
+		if(ptr->type & TYPE_MONSTER) {
+			myswprintf(textBuffer, L"%ls", dataManager.GetName(ptr->code));
 			textFont->draw(textBuffer, mainGame->Resize(859, 164 + i * 66, 955, 185 + i * 66), 0xff000000, false, false);
 			textFont->draw(textBuffer, mainGame->Resize(860, 165 + i * 66, 955, 185 + i * 66), 0xffffffff, false, false);
-			if(!(ptr->second.type & TYPE_LINK)) {
+			if(!(ptr->type & TYPE_LINK)) {
 				const wchar_t* form = L"\u2605";
-				if(ptr->second.type & TYPE_XYZ) form = L"\u2606";
-				myswprintf(textBuffer, L"%ls/%ls %ls%d", dataManager.FormatAttribute(ptr->second.attribute), dataManager.FormatRace(ptr->second.race), form, ptr->second.level);
+				if(ptr->type & TYPE_XYZ) form = L"\u2606";
+				myswprintf(textBuffer, L"%ls/%ls %ls%d", dataManager.FormatAttribute(ptr->attribute), dataManager.FormatRace(ptr->race), form, ptr->level);
 				textFont->draw(textBuffer, mainGame->Resize(859, 186 + i * 66, 955, 207 + i * 66), 0xff000000, false, false);
 				textFont->draw(textBuffer, mainGame->Resize(860, 187 + i * 66, 955, 207 + i * 66), 0xffffffff, false, false);
-				if(ptr->second.attack < 0 && ptr->second.defense < 0)
+				if(ptr->attack < 0 && ptr->defense < 0)
 					myswprintf(textBuffer, L"?/?");
-				else if(ptr->second.attack < 0)
-					myswprintf(textBuffer, L"?/%d", ptr->second.defense);
-				else if(ptr->second.defense < 0)
-					myswprintf(textBuffer, L"%d/?", ptr->second.attack);
-				else myswprintf(textBuffer, L"%d/%d", ptr->second.attack, ptr->second.defense);
+				else if(ptr->attack < 0)
+					myswprintf(textBuffer, L"?/%d", ptr->defense);
+				else if(ptr->defense < 0)
+					myswprintf(textBuffer, L"%d/?", ptr->attack);
+				else myswprintf(textBuffer, L"%d/%d", ptr->attack, ptr->defense);
 			} else {
-				myswprintf(textBuffer, L"%ls/%ls LINK-%d", dataManager.FormatAttribute(ptr->second.attribute), dataManager.FormatRace(ptr->second.race), ptr->second.level);
+				myswprintf(textBuffer, L"%ls/%ls LINK-%d", dataManager.FormatAttribute(ptr->attribute), dataManager.FormatRace(ptr->race), ptr->level);
 				textFont->draw(textBuffer, mainGame->Resize(859, 186 + i * 66, 955, 207 + i * 66), 0xff000000, false, false);
 				textFont->draw(textBuffer, mainGame->Resize(860, 187 + i * 66, 955, 207 + i * 66), 0xffffffff, false, false);
-				if(ptr->second.attack < 0)
+				if(ptr->attack < 0)
 					myswprintf(textBuffer, L"?/-");
-				else myswprintf(textBuffer, L"%d/-", ptr->second.attack);
+				else myswprintf(textBuffer, L"%d/-", ptr->attack);
 			}
-			if(ptr->second.type & TYPE_PENDULUM) {
+			if(ptr->type & TYPE_PENDULUM) {
 				wchar_t scaleBuffer[16];
-				myswprintf(scaleBuffer, L" %d/%d", ptr->second.lscale, ptr->second.rscale);
+				myswprintf(scaleBuffer, L" %d/%d", ptr->lscale, ptr->rscale);
 				wcscat(textBuffer, scaleBuffer);
 			}
-			if(ptr->second.ot == 1)
+			if(ptr->ot == 1)
 				wcscat(textBuffer, L" [OCG]");
-			else if(ptr->second.ot == 2)
+			else if(ptr->ot == 2)
 				wcscat(textBuffer, L" [TCG]");
-			else if(ptr->second.ot == 4)
+			else if(ptr->ot == 4)
 				wcscat(textBuffer, L" [Anime]");
-			else if (ptr->second.ot == 5)
+			else if (ptr->ot == 5)
 				wcscat(textBuffer, L" [RUSH]");
 			textFont->draw(textBuffer, mainGame->Resize(859, 208 + i * 66, 955, 229 + i * 66), 0xff000000, false, false);
 			textFont->draw(textBuffer, mainGame->Resize(860, 209 + i * 66, 955, 229 + i * 66), 0xffffffff, false, false);
 		} else {
-			myswprintf(textBuffer, L"%ls", dataManager.GetName(ptr->first));
+			myswprintf(textBuffer, L"%ls", dataManager.GetName(ptr->code));
 			textFont->draw(textBuffer, mainGame->Resize(859, 164 + i * 66, 955, 185 + i * 66), 0xff000000, false, false);
 			textFont->draw(textBuffer, mainGame->Resize(860, 165 + i * 66, 955, 185 + i * 66), 0xffffffff, false, false);
-			const wchar_t* ptype = dataManager.FormatType(ptr->second.type);
+			const wchar_t* ptype = dataManager.FormatType(ptr->type);
 			textFont->draw(ptype, mainGame->Resize(859, 186 + i * 66, 955, 207 + i * 66), 0xff000000, false, false);
 			textFont->draw(ptype, mainGame->Resize(860, 187 + i * 66, 955, 207 + i * 66), 0xffffffff, false, false);
 			textBuffer[0] = 0;
-			if(ptr->second.ot == 1)
+			if(ptr->ot == 1)
 				wcscat(textBuffer, L"[OCG]");
-			else if(ptr->second.ot == 2)
+			else if(ptr->ot == 2)
 				wcscat(textBuffer, L"[TCG]");
-			else if(ptr->second.ot == 4)
+			else if(ptr->ot == 4)
 				wcscat(textBuffer, L"[Anime]");
-			else if (ptr->second.ot == 5)
+			else if (ptr->ot == 5)
 				wcscat(textBuffer, L" [RUSH]");
 			textFont->draw(textBuffer, mainGame->Resize(859, 208 + i * 66, 955, 229 + i * 66), 0xff000000, false, false);
 			textFont->draw(textBuffer, mainGame->Resize(860, 209 + i * 66, 955, 229 + i * 66), 0xffffffff, false, false);
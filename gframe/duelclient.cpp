@@ -27,6 +27,7 @@ int DuelClient::select_unselect_hint = 0;
 int DuelClient::last_select_hint = 0;
 char DuelClient::last_successful_msg[0x2000];
 unsigned int DuelClient::last_successful_msg_length = 0;
+std::vector<char> DuelClient::replay_parts;
 wchar_t DuelClient::event_string[256];
 mt19937 DuelClient::rnd;
 
@@ -565,6 +566,7 @@ void DuelClient::HandleSTOCPacketLan(char* data, unsigned int len) {
 		break;
 	}
 	case STOC_DUEL_START: {
+		replay_parts.clear();
 		mainGame->HideElement(mainGame->wHostPrepare);
 		mainGame->WaitFrameSignal(11);
 		mainGame->gMutex.lock();
@@ -675,7 +677,23 @@ void DuelClient::HandleSTOCPacketLan(char* data, unsigned int len) {
 			mainGame->device->closeDevice();
 		break;
 	}
+	case STOC_REPLAY_PART: {
+		// chunked replays have no size limit, this only stops a broken server from filling the memory
+		if(replay_parts.size() + len - 1 > 0x4000000) {
+			replay_parts.clear();
+			break;
+		}
+		replay_parts.insert(replay_parts.end(), pdata, pdata + len - 1);
+		break;
+	}
 	case STOC_REPLAY: {
+		std::vector<char> replay_data;
+		replay_data.swap(replay_parts);
+		replay_data.insert(replay_data.end(), pdata, pdata + len - 1);
+		if(replay_data.size() < sizeof(ReplayHeader))
+			break;
+		pdata = replay_data.data();
+		len = (unsigned int)replay_data.size() + 1;
 		mainGame->gMutex.lock();
 		mainGame->wPhase->setVisible(false);
 		mainGame->wSurrender->setVisible(false);
@@ -716,8 +734,7 @@ void DuelClient::HandleSTOCPacketLan(char* data, unsigned int len) {
 			Replay new_replay;
 			memcpy(&new_replay.pheader, prep, sizeof(ReplayHeader));
 			prep += sizeof(ReplayHeader);
-			memcpy(new_replay.comp_data, prep, len - sizeof(ReplayHeader) - 1);
-			new_replay.comp_size = len - sizeof(ReplayHeader) - 1;
+			new_replay.comp_data.assign(prep, prep + len - sizeof(ReplayHeader) - 1);
 			if(mainGame->actionParam)
 				new_replay.SaveReplay(mainGame->ebRSName->getText());
 			else
@@ -1172,6 +1189,7 @@ int DuelClient::ClientAnalyze(char * msg, unsigned int len) {
 		mainGame->WaitFrameSignal(40);
 		mainGame->showcard = 0;
 		mainGame->gMutex.lock();
+		mainGame->dField.query_cache.Clear();
 		int playertype = BufferIO::ReadInt8(pbuf);
 		mainGame->dInfo.isFirst =  (playertype & 0xf) ? false : true;
 		if(playertype & 0xf0)
@@ -1212,10 +1230,30 @@ int DuelClient::ClientAnalyze(char * msg, unsigned int len) {
 		int player = mainGame->LocalPlayer(BufferIO::ReadInt8(pbuf));
 		int location = BufferIO::ReadInt8(pbuf);
 		mainGame->gMutex.lock();
+		mainGame->dField.query_cache.StoreUpdate(msg, len);
 		mainGame->dField.UpdateFieldCard(player, location, pbuf);
 		mainGame->gMutex.unlock();
 		return true;
 	}
+	case MSG_UPDATE_DATA_DELTA: {
+		char query_buffer[0x4000];
+		mainGame->gMutex.lock();
+		if(mainGame->dField.query_cache.ReadDelta(msg, len, query_buffer, sizeof(query_buffer))) {
+			pbuf = query_buffer + 1;
+			int player = mainGame->LocalPlayer(BufferIO::ReadInt8(pbuf));
+			int location = BufferIO::ReadInt8(pbuf);
+			mainGame->dField.UpdateFieldCard(player, location, pbuf);
+		} else {
+			// the cache no longer matches the server, start the location over from a full update
+			CTOS_RequestField csrf;
+			csrf.player = BufferIO::ReadUInt8(pbuf);
+			csrf.location = BufferIO::ReadUInt8(pbuf);
+			mainGame->dField.query_cache.Invalidate(csrf.player, csrf.location);
+			SendPacketToServer(CTOS_REQUEST_FIELD, csrf);
+		}
+		mainGame->gMutex.unlock();
+		return true;
+	}
 	case MSG_UPDATE_CARD: {
 		int player = mainGame->LocalPlayer(BufferIO::ReadInt8(pbuf));
 		int loc = BufferIO::ReadInt8(pbuf);
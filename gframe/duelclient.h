@@ -35,6 +35,8 @@ private:
 	static int last_select_hint;
 	static char last_successful_msg[0x2000];
 	static unsigned int last_successful_msg_length;
+	// leading pieces of a replay longer than one packet, STOC_REPLAY brings the rest
+	static std::vector<char> replay_parts;
 	static wchar_t event_string[256];
 	static mt19937 rnd;
 public:
@@ -93,6 +93,15 @@ bool ClientField::OnEvent(const irr::SEvent& event) {
 				ReplayMode::Undo();
 				break;
 			}
+			case BUTTON_REPLAY_SPEED: {
+				// 1x, 2x, 4x, 8x, 16x
+				mainGame->replaySpeed = mainGame->replaySpeed >= 16 ? 1 : mainGame->replaySpeed * 2;
+				mainGame->replayFrames = 0;
+				wchar_t speed[8];
+				myswprintf(speed, L"%dx", mainGame->replaySpeed);
+				mainGame->btnReplaySpeed->setText(speed);
+				break;
+			}
 			case BUTTON_REPLAY_SAVE: {
 				if(mainGame->ebRSName->getText()[0] == 0)
 					break;
@@ -1855,6 +1864,7 @@ bool ClientField::OnCommonEvent(const irr::SEvent& event) {
 			}
 			case CHECKBOX_PREFER_EXPANSION: {
 				mainGame->gameConf.prefer_expansion_script = mainGame->chkPreferExpansionScript->isChecked() ? 1 : 0;
+				dataManager.prefer_expansion_script = mainGame->gameConf.prefer_expansion_script != 0;
 				return true;
 				break;
 			}
@@ -4,14 +4,13 @@
 #include "data_manager.h"
 #include "deck_manager.h"
 #include "replay.h"
+#include "replay_library.h"
 #include "materials.h"
 #include "duelclient.h"
 #include "netserver.h"
 #include "single_mode.h"
 #include <sstream>
 
-const unsigned short PRO_VERSION = 0x133D;
-
 namespace ygo {
 
 Game* mainGame;
@@ -76,6 +75,8 @@ bool Game::Initialize() {
 	linePatternGL = 0x0f0f;
 	waitFrame = 0;
 	signalFrame = 0;
+	replaySpeed = 1;
+	replayFrames = 0;
 	showcard = 0;
 	is_attacking = false;
 	lpframe = 0;
@@ -97,8 +98,18 @@ bool Game::Initialize() {
 		ErrorLog("Failed to load textures!");
 		return false;
 	}
-	LoadExpansionDB();
-	if(!dataManager.LoadDB("cards.cdb")) {
+	std::vector<std::string> databases;
+	DataManager::ListDBs("./expansions", databases);
+	databases.push_back("cards.cdb");
+	std::vector<bool> loaded = dataManager.LoadDBs(databases);
+	if(enable_log & 0x2) {
+		for(auto& step : dataManager.load_times) {
+			char msgbuf[1024];
+			DataManager::FormatLoadTime(step, msgbuf, sizeof(msgbuf));
+			ErrorLog(msgbuf);
+		}
+	}
+	if(!loaded.back()) {
 		ErrorLog("Failed to load card database (cards.cdb)!");
 		return false;
 	}
@@ -107,6 +118,7 @@ bool Game::Initialize() {
 		return false;
 	}
 	dataManager.LoadStrings("./expansions/strings.conf");
+	dataManager.prefer_expansion_script = gameConf.prefer_expansion_script != 0;
 	env = device->getGUIEnvironment();
 	numFont = irr::gui::CGUITTFont::createTTFont(env, gameConf.numfont, 16);
 	adFont = irr::gui::CGUITTFont::createTTFont(env, gameConf.numfont, 12);
@@ -642,8 +654,15 @@ bool Game::Initialize() {
 	wReplay = env->addWindow(rect<s32>(220, 100, 800, 520), false, dataManager.GetSysString(1202));
 	wReplay->getCloseButton()->setVisible(false);
 	wReplay->setVisible(false);
-	lstReplayList = env->addListBox(rect<s32>(10, 30, 350, 400), wReplay, LISTBOX_REPLAY_LIST, true);
+	ebReplayFilter = env->addEditBox(L"", rect<s32>(10, 30, 350, 50), true, wReplay, EDITBOX_REPLAY_FILTER);
+	ebReplayFilter->setTextAlignment(irr::gui::EGUIA_UPPERLEFT, irr::gui::EGUIA_CENTER);
+	lstReplayList = env->addListBox(rect<s32>(10, 55, 350, 380), wReplay, LISTBOX_REPLAY_LIST, true);
 	lstReplayList->setItemHeight(18);
+	btnReplayPrevPage = env->addButton(rect<s32>(10, 385, 50, 410), wReplay, BUTTON_REPLAY_PREV_PAGE, L"<");
+	stReplayPage = env->addStaticText(L"", rect<s32>(55, 385, 305, 410), false, false, wReplay);
+	stReplayPage->setTextAlignment(irr::gui::EGUIA_CENTER, irr::gui::EGUIA_CENTER);
+	btnReplayNextPage = env->addButton(rect<s32>(310, 385, 350, 410), wReplay, BUTTON_REPLAY_NEXT_PAGE, L">");
+	replayPage = 0;
 	btnLoadReplay = env->addButton(rect<s32>(470, 325, 570, 350), wReplay, BUTTON_LOAD_REPLAY, dataManager.GetSysString(1348));
 	btnExportDecks = env->addButton(rect<s32>(470, 355, 570, 380), wReplay, BUTTON_EXPORT_DECKS, dataManager.GetSysString(1800));
 	btnDeleteReplay = env->addButton(rect<s32>(360, 355, 460, 380), wReplay, BUTTON_DELETE_REPLAY, dataManager.GetSysString(1361));
@@ -698,7 +717,7 @@ bool Game::Initialize() {
 	btnRSYes = env->addButton(rect<s32>(70, 80, 140, 105), wReplaySave, BUTTON_REPLAY_SAVE, dataManager.GetSysString(1341));
 	btnRSNo = env->addButton(rect<s32>(170, 80, 240, 105), wReplaySave, BUTTON_REPLAY_CANCEL, dataManager.GetSysString(1212));
 	//replay control
-	wReplayControl = env->addStaticText(L"", rect<s32>(205, 118, 295, 273), true, false, 0, -1, true);
+	wReplayControl = env->addStaticText(L"", rect<s32>(205, 93, 295, 273), true, false, 0, -1, true);
 	wReplayControl->setVisible(false);
 	btnReplayStart = env->addButton(rect<s32>(5, 5, 85, 25), wReplayControl, BUTTON_REPLAY_START, dataManager.GetSysString(1343));
 	btnReplayPause = env->addButton(rect<s32>(5, 30, 85, 50), wReplayControl, BUTTON_REPLAY_PAUSE, dataManager.GetSysString(1344));
@@ -706,6 +725,7 @@ bool Game::Initialize() {
 	btnReplayUndo = env->addButton(rect<s32>(5, 80, 85, 100), wReplayControl, BUTTON_REPLAY_UNDO, dataManager.GetSysString(1360));
 	btnReplaySwap = env->addButton(rect<s32>(5, 105, 85, 125), wReplayControl, BUTTON_REPLAY_SWAP, dataManager.GetSysString(1346));
 	btnReplayExit = env->addButton(rect<s32>(5, 130, 85, 150), wReplayControl, BUTTON_REPLAY_EXIT, dataManager.GetSysString(1347));
+	btnReplaySpeed = env->addButton(rect<s32>(5, 155, 85, 175), wReplayControl, BUTTON_REPLAY_SPEED, L"1x");
 	//chat
 	wChat = env->addWindow(rect<s32>(305, 615, 1020, 640), false, L"");
 	wChat->getCloseButton()->setVisible(false);
@@ -921,15 +941,6 @@ void Game::SetStaticText(irr::gui::IGUIStaticText* pControl, u32 cWidth, irr::gu
 	dataManager.strBuffer[pbuffer] = 0;
 	pControl->setText(dataManager.strBuffer);
 }
-void Game::LoadExpansionDB() {
-	FileSystem::TraversalDir("./expansions", [](const char* name, bool isdir) {
-		if(!isdir && strrchr(name, '.') && !mystrncasecmp(strrchr(name, '.'), ".cdb", 4)) {
-			char fpath[1024];
-			sprintf(fpath, "./expansions/%s", name);
-			dataManager.LoadDB(fpath);
-		}
-	});
-}
 void Game::RefreshDeck(irr::gui::IGUIComboBox* cbDeck) {
 	cbDeck->clear();
 	FileSystem::TraversalDir(L"./deck", [cbDeck](const wchar_t* name, bool isdir) {
@@ -949,11 +960,23 @@ void Game::RefreshDeck(irr::gui::IGUIComboBox* cbDeck) {
 	}
 }
 void Game::RefreshReplay() {
+	ReplayLibrary::Refresh();
+	replayPage = 0;
+	RefreshReplayPage();
+}
+void Game::RefreshReplayPage() {
 	lstReplayList->clear();
-	FileSystem::TraversalDir(L"./replay", [this](const wchar_t* name, bool isdir) {
-		if(!isdir && wcsrchr(name, '.') && !mywcsncasecmp(wcsrchr(name, '.'), L".yrp", 4) && Replay::CheckReplay(name))
-			lstReplayList->addItem(name);
-	});
+	int count = ReplayLibrary::GetCount();
+	int pages = (count + REPLAY_LIBRARY_PAGE - 1) / REPLAY_LIBRARY_PAGE;
+	if(replayPage >= pages)
+		replayPage = pages ? pages - 1 : 0;
+	for(int i = replayPage * REPLAY_LIBRARY_PAGE; i < count && i < (replayPage + 1) * REPLAY_LIBRARY_PAGE; ++i)
+		lstReplayList->addItem(ReplayLibrary::GetEntry(i)->name.c_str());
+	wchar_t pagebuf[32];
+	myswprintf(pagebuf, L"%d/%d", replayPage + 1, pages ? pages : 1);
+	stReplayPage->setText(pagebuf);
+	btnReplayPrevPage->setEnabled(replayPage > 0);
+	btnReplayNextPage->setEnabled(replayPage + 1 < pages);
 }
 void Game::RefreshSingleplay() {
 	lstSinglePlayList->clear();
@@ -1223,6 +1246,9 @@ void Game::PlayMusic(char* song, bool loop) {
 	}
 }
 void Game::PlaySound(char* sound) {
+	// the sounds would pile up on each other
+	if(dInfo.isReplay && replaySpeed > 2)
+		return;
 	if (gameConf.enablesound) {
 		engineSound->play2D(sound);
 		engineSound->setSoundVolume(gameConf.soundvolume);
@@ -1250,9 +1276,9 @@ void Game::ShowCardInfo(int code) {
 	if(!gameConf.hide_setname) {
 		unsigned long long sc = cd.setcode;
 		if(cd.alias) {
-			auto aptr = dataManager._datas.find(cd.alias);
-			if(aptr != dataManager._datas.end())
-				sc = aptr->second.setcode;
+			auto aptr = dataManager.GetCodePointer(cd.alias);
+			if(aptr)
+				sc = aptr->setcode;
 		}
 		if(sc) {
 			offset = 23;
@@ -1533,13 +1559,14 @@ void Game::OnResize()
 	btnClearLog->setRelativePosition(Resize(160, 300, 260, 325));
 
 	btnLeaveGame->setRelativePosition(Resize(205, 5, 295, 80));
-	wReplayControl->setRelativePosition(Resize(205, 143, 295, 273));
+	wReplayControl->setRelativePosition(Resize(205, 118, 295, 273));
 	btnReplayStart->setRelativePosition(Resize(5, 5, 85, 25));
 	btnReplayPause->setRelativePosition(Resize(5, 5, 85, 25));
 	btnReplayStep->setRelativePosition(Resize(5, 55, 85, 75));
 	btnReplayUndo->setRelativePosition(Resize(5, 80, 85, 100));
 	btnReplaySwap->setRelativePosition(Resize(5, 30, 85, 50));
 	btnReplayExit->setRelativePosition(Resize(5, 105, 85, 125));
+	btnReplaySpeed->setRelativePosition(Resize(5, 130, 85, 150));
 
 	btnSpectatorSwap->setRelativePosition(Resize(205, 100, 295, 135));
 
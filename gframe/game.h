@@ -115,9 +115,9 @@ public:
 	void BuildProjectionMatrix(irr::core::matrix4& mProjection, f32 left, f32 right, f32 bottom, f32 top, f32 znear, f32 zfar);
 	void InitStaticText(irr::gui::IGUIStaticText* pControl, u32 cWidth, u32 cHeight, irr::gui::CGUITTFont* font, const wchar_t* text);
 	void SetStaticText(irr::gui::IGUIStaticText* pControl, u32 cWidth, irr::gui::CGUITTFont* font, const wchar_t* text, u32 pos = 0);
-	void LoadExpansionDB();
 	void RefreshDeck(irr::gui::IGUIComboBox* cbDeck);
 	void RefreshReplay();
+	void RefreshReplayPage();
 	void RefreshSingleplay();
 	void RefreshBot();
 	void DrawSelectionLine(irr::video::S3DVertex* vec, bool strip, int width, float* cv);
@@ -207,6 +207,9 @@ public:
 	unsigned short linePatternGL;
 	int waitFrame;
 	int signalFrame;
+	// replay playback speed, animation frames are divided by it
+	int replaySpeed;
+	int replayFrames;
 	int actionParam;
 	const wchar_t* showingtext;
 	int showcard;
@@ -364,6 +367,11 @@ public:
 	irr::gui::IGUIButton* btnRenameReplay;
 	irr::gui::IGUIButton* btnReplayCancel;
 	irr::gui::IGUIEditBox* ebRepStartTurn;
+	irr::gui::IGUIEditBox* ebReplayFilter;
+	irr::gui::IGUIButton* btnReplayPrevPage;
+	irr::gui::IGUIButton* btnReplayNextPage;
+	irr::gui::IGUIStaticText* stReplayPage;
+	int replayPage;
 	//single play
 	irr::gui::IGUIWindow* wSinglePlay;
 	irr::gui::IGUIListBox* lstBotList;
@@ -541,6 +549,7 @@ public:
 	irr::gui::IGUIButton* btnReplayUndo;
 	irr::gui::IGUIButton* btnReplayExit;
 	irr::gui::IGUIButton* btnReplaySwap;
+	irr::gui::IGUIButton* btnReplaySpeed;
 	//surrender/leave
 	irr::gui::IGUIButton* btnLeaveGame;
 	//swap
@@ -607,6 +616,9 @@ extern Game* mainGame;
 #define BUTTON_CANCEL_REPLAY		132
 #define BUTTON_DELETE_REPLAY		133
 #define BUTTON_RENAME_REPLAY		134
+#define EDITBOX_REPLAY_FILTER		135
+#define BUTTON_REPLAY_PREV_PAGE		136
+#define BUTTON_REPLAY_NEXT_PAGE		137
 #define BUTTON_EXPORT_DECKS			139
 #define BUTTON_REPLAY_START			140
 #define BUTTON_REPLAY_PAUSE			141
@@ -616,6 +628,7 @@ extern Game* mainGame;
 #define BUTTON_REPLAY_SWAP			145
 #define BUTTON_REPLAY_SAVE			146
 #define BUTTON_REPLAY_CANCEL		147
+#define BUTTON_REPLAY_SPEED			148
 #define LISTBOX_SINGLEPLAY_LIST		150
 #define BUTTON_LOAD_SINGLEPLAY		151
 #define BUTTON_CANCEL_SINGLEPLAY	152
@@ -4,6 +4,7 @@
 #include "duelclient.h"
 #include "deck_manager.h"
 #include "replay_mode.h"
+#include "replay_library.h"
 #include "single_mode.h"
 #include "image_manager.h"
 #include "game.h"
@@ -18,11 +19,11 @@ void UpdateDeck() {
 	BufferIO::WriteInt32(pdeck, deckManager.current_deck.main.size() + deckManager.current_deck.extra.size());
 	BufferIO::WriteInt32(pdeck, deckManager.current_deck.side.size());
 	for(size_t i = 0; i < deckManager.current_deck.main.size(); ++i)
-		BufferIO::WriteInt32(pdeck, deckManager.current_deck.main[i]->first);
+		BufferIO::WriteInt32(pdeck, deckManager.current_deck.main[i]->code);
 	for(size_t i = 0; i < deckManager.current_deck.extra.size(); ++i)
-		BufferIO::WriteInt32(pdeck, deckManager.current_deck.extra[i]->first);
+		BufferIO::WriteInt32(pdeck, deckManager.current_deck.extra[i]->code);
 	for(size_t i = 0; i < deckManager.current_deck.side.size(); ++i)
-		BufferIO::WriteInt32(pdeck, deckManager.current_deck.side[i]->first);
+		BufferIO::WriteInt32(pdeck, deckManager.current_deck.side[i]->code);
 	DuelClient::SendBufferToServer(CTOS_UPDATE_DECK, deckbuf, pdeck - deckbuf);
 }
 bool MenuHandler::OnEvent(const irr::SEvent& event) {
@@ -209,39 +210,28 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 				break;
 			}
 			case BUTTON_EXPORT_DECKS: {
-				if (mainGame->lstReplayList->getSelected() == -1)
-					break;
-				Replay replay;
-				wchar_t ex_filename[256];
-				wchar_t namebuf[4][20];
-				wchar_t filename[256];
-				myswprintf(ex_filename, L"%ls", mainGame->lstReplayList->getListItem(mainGame->lstReplayList->getSelected()));
-				if (!replay.OpenReplay(ex_filename))
-					break;
-				const ReplayHeader& rh = replay.pheader;
-				if (rh.flag & REPLAY_SINGLE_MODE)
-					break;
-				int max = (rh.flag & REPLAY_TAG) ? 4 : 2;
-				//player name
-				for (int i = 0; i < max; ++i)
-					replay.ReadName(namebuf[i]);
-				//skip pre infos
-				for (int i = 0; i < 4; ++i)
-					replay.ReadInt32();
-				//deck
-				for (int i = 0; i < max; ++i) {
-					int main = replay.ReadInt32();
-					Deck tmp_deck;
-					for (int j = 0; j < main; ++j)
-						tmp_deck.main.push_back(dataManager.GetCodePointer(replay.ReadInt32()));
-					int extra = replay.ReadInt32();
-					for (int j = 0; j < extra; ++j)
-						tmp_deck.extra.push_back(dataManager.GetCodePointer(replay.ReadInt32()));
-					myswprintf(filename, L"%ls %ls", ex_filename, namebuf[i]);
-					deckManager.SaveDeck(tmp_deck, filename);
-				}
-				mainGame->stACMessage->setText(dataManager.GetSysString(1335));
-				mainGame->PopupElement(mainGame->wACMessage, 20);
+				if (mainGame->lstReplayList->getSelected() == -1)
+					break;
+				ReplayEntry* entry = ReplayLibrary::GetEntry(mainGame->replayPage * REPLAY_LIBRARY_PAGE + mainGame->lstReplayList->getSelected());
+				if (!entry)
+					break;
+				wchar_t filename[256];
+				const ReplayHeader& rh = entry->header;
+				if (rh.flag & REPLAY_SINGLE_MODE)
+					break;
+				int max = (rh.flag & REPLAY_TAG) ? 4 : 2;
+				//deck
+				for (int i = 0; i < max; ++i) {
+					Deck tmp_deck;
+					for (int code : entry->main[i])
+						tmp_deck.main.push_back(dataManager.GetCodePointer(code));
+					for (int code : entry->extra[i])
+						tmp_deck.extra.push_back(dataManager.GetCodePointer(code));
+					myswprintf(filename, L"%ls %ls", entry->name.c_str(), entry->players[i]);
+					deckManager.SaveDeck(tmp_deck, filename);
+				}
+				mainGame->stACMessage->setText(dataManager.GetSysString(1335));
+				mainGame->PopupElement(mainGame->wACMessage, 20);
 				break;
 			}
 			case BUTTON_LOAD_REPLAY: {
@@ -287,6 +277,15 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 				prev_sel = sel;
 				break;
 			}
+			case BUTTON_REPLAY_PREV_PAGE:
+			case BUTTON_REPLAY_NEXT_PAGE: {
+				mainGame->replayPage += (id == BUTTON_REPLAY_NEXT_PAGE) ? 1 : -1;
+				if(mainGame->replayPage < 0)
+					mainGame->replayPage = 0;
+				mainGame->stReplayInfo->setText(L"");
+				mainGame->RefreshReplayPage();
+				break;
+			}
 			case BUTTON_RENAME_REPLAY: {
 				int sel = mainGame->lstReplayList->getSelected();
 				if(sel == -1)
@@ -406,7 +405,8 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 				if(prev_operation == BUTTON_DELETE_REPLAY) {
 					if(Replay::DeleteReplay(mainGame->lstReplayList->getListItem(prev_sel))) {
 						mainGame->stReplayInfo->setText(L"");
-						mainGame->lstReplayList->removeItem(prev_sel);
+						ReplayLibrary::RemoveEntry(mainGame->lstReplayList->getListItem(prev_sel));
+						mainGame->RefreshReplayPage();
 					}
 				}
 				prev_operation = 0;
@@ -428,6 +428,7 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 						myswprintf(newname, L"%ls.yrp", mainGame->ebRSName->getText());
 					}
 					if(Replay::RenameReplay(mainGame->lstReplayList->getListItem(prev_sel), newname)) {
+						ReplayLibrary::RenameEntry(mainGame->lstReplayList->getListItem(prev_sel), newname);
 						mainGame->lstReplayList->setItem(prev_sel, newname, -1);
 					} else {
 						mainGame->env->addMessageBox(L"", dataManager.GetSysString(1365));
@@ -465,30 +466,40 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 				int sel = mainGame->lstReplayList->getSelected();
 				if(sel == -1)
 					break;
-				if(!ReplayMode::cur_replay.OpenReplay(mainGame->lstReplayList->getListItem(sel)))
+				ReplayEntry* entry = ReplayLibrary::GetEntry(mainGame->replayPage * REPLAY_LIBRARY_PAGE + sel);
+				if(!entry)
 					break;
 				wchar_t infobuf[256];
 				std::wstring repinfo;
 				time_t curtime;
-				if(ReplayMode::cur_replay.pheader.flag & REPLAY_UNIFORM)
-					curtime = ReplayMode::cur_replay.pheader.start_time;
+				if(entry->header.flag & REPLAY_UNIFORM)
+					curtime = entry->header.start_time;
 				else
-					curtime = ReplayMode::cur_replay.pheader.seed;
+					curtime = entry->header.seed;
 				tm* st = localtime(&curtime);
 				wcsftime(infobuf, 256, L"%Y/%m/%d %H:%M:%S\n", st);
 				repinfo.append(infobuf);
-				wchar_t namebuf[4][20];
-				ReplayMode::cur_replay.ReadName(namebuf[0]);
-				ReplayMode::cur_replay.ReadName(namebuf[1]);
-				if(ReplayMode::cur_replay.pheader.flag & REPLAY_TAG) {
-					ReplayMode::cur_replay.ReadName(namebuf[2]);
-					ReplayMode::cur_replay.ReadName(namebuf[3]);
-				}
-				if(ReplayMode::cur_replay.pheader.flag & REPLAY_TAG)
+				wchar_t (*namebuf)[20] = entry->players;
+				if(entry->header.flag & REPLAY_TAG)
 					myswprintf(infobuf, L"%ls\n%ls\n===VS===\n%ls\n%ls\n", namebuf[0], namebuf[1], namebuf[2], namebuf[3]);
 				else
 					myswprintf(infobuf, L"%ls\n===VS===\n%ls\n", namebuf[0], namebuf[1]);
 				repinfo.append(infobuf);
+				if(entry->turns) {
+					myswprintf(infobuf, dataManager.GetSysString(1354), entry->turns);
+					repinfo.append(infobuf);
+					repinfo.append(L"\n");
+				}
+				if(entry->winner == 0 || entry->winner == 1) {
+					wchar_t winner[64];
+					if(entry->header.flag & REPLAY_TAG)
+						myswprintf(winner, L"%ls+%ls", namebuf[entry->winner * 2], namebuf[entry->winner * 2 + 1]);
+					else
+						myswprintf(winner, L"%ls", namebuf[entry->winner]);
+					myswprintf(infobuf, dataManager.GetSysString(1355), winner);
+					repinfo.append(infobuf);
+					repinfo.append(L"\n");
+				}
 				mainGame->ebRepStartTurn->setText(L"1");
 				mainGame->SetStaticText(mainGame->stReplayInfo, 180, mainGame->guiFont, repinfo.c_str());
 				break;
@@ -553,6 +564,18 @@ bool MenuHandler::OnEvent(const irr::SEvent& event) {
 			}
 			break;
 		}
+		case irr::gui::EGET_EDITBOX_CHANGED: {
+			switch(id) {
+			case EDITBOX_REPLAY_FILTER: {
+				ReplayLibrary::Filter(mainGame->ebReplayFilter->getText());
+				mainGame->replayPage = 0;
+				mainGame->stReplayInfo->setText(L"");
+				mainGame->RefreshReplayPage();
+				break;
+			}
+			}
+			break;
+		}
 		case irr::gui::EGET_CHECKBOX_CHANGED: {
 			switch(id) {
 			case CHECKBOX_HP_READY: {
@@ -8,6 +8,9 @@
 #ifndef _WIN32
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <vector>
 #include <algorithm>
 #endif
@@ -51,6 +54,42 @@ public:
 		return MakeDir(wdir);
 	}
 
+	static bool GetFileInfo(const wchar_t* wfile, unsigned long long* size, unsigned long long* mtime) {
+		WIN32_FILE_ATTRIBUTE_DATA fdata;
+		if(!GetFileAttributesExW(wfile, GetFileExInfoStandard, &fdata))
+			return false;
+		*size = ((unsigned long long)fdata.nFileSizeHigh << 32) | fdata.nFileSizeLow;
+		*mtime = ((unsigned long long)fdata.ftLastWriteTime.dwHighDateTime << 32) | fdata.ftLastWriteTime.dwLowDateTime;
+		return true;
+	}
+
+	// read only view of a whole file, 0 if it cannot be mapped or is empty
+	static const unsigned char* MapFile(const wchar_t* wfile, size_t* size) {
+		HANDLE fh = CreateFileW(wfile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(fh == INVALID_HANDLE_VALUE)
+			return 0;
+		LARGE_INTEGER fsize;
+		if(!GetFileSizeEx(fh, &fsize) || fsize.QuadPart == 0 || (unsigned long long)fsize.QuadPart > (size_t)-1) {
+			CloseHandle(fh);
+			return 0;
+		}
+		HANDLE mh = CreateFileMappingW(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+		CloseHandle(fh);
+		if(!mh)
+			return 0;
+		// the view keeps the mapping alive
+		const unsigned char* data = (const unsigned char*)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mh);
+		if(!data)
+			return 0;
+		*size = (size_t)fsize.QuadPart;
+		return data;
+	}
+
+	static void UnmapFile(const unsigned char* data, size_t size) {
+		UnmapViewOfFile(data);
+	}
+
 	static void TraversalDir(const wchar_t* wpath, const std::function<void(const wchar_t*, bool)>& cb) {
 		wchar_t findstr[1024];
 		wcscpy(findstr, wpath);
@@ -112,6 +151,46 @@ public:
 		return MakeDir(dir);
 	}
 
+	static bool GetFileInfo(const char* file, unsigned long long* size, unsigned long long* mtime) {
+		struct stat fileStat;
+		if(stat(file, &fileStat) != 0)
+			return false;
+		*size = fileStat.st_size;
+		*mtime = fileStat.st_mtime;
+		return true;
+	}
+
+	static bool GetFileInfo(const wchar_t* wfile, unsigned long long* size, unsigned long long* mtime) {
+		char file[1024];
+		BufferIO::EncodeUTF8(wfile, file);
+		return GetFileInfo(file, size, mtime);
+	}
+
+	// read only view of a whole file, 0 if it cannot be mapped or is empty
+	static const unsigned char* MapFile(const wchar_t* wfile, size_t* size) {
+		char file[1024];
+		BufferIO::EncodeUTF8(wfile, file);
+		int fd = open(file, O_RDONLY);
+		if(fd < 0)
+			return 0;
+		struct stat fileStat;
+		if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+			close(fd);
+			return 0;
+		}
+		void* data = mmap(0, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(data == MAP_FAILED)
+			return 0;
+		madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+		*size = fileStat.st_size;
+		return (const unsigned char*)data;
+	}
+
+	static void UnmapFile(const unsigned char* data, size_t size) {
+		munmap((void*)data, size);
+	}
+
 	struct file_unit {
 		std::string filename;
 		bool is_dir;
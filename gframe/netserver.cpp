@@ -1,21 +1,40 @@
 #include "netserver.h"
 #include "single_duel.h"
 #include "tag_duel.h"
+#include "replay_writer.h"
+#include <signal.h>
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
 
 namespace ygo {
-std::unordered_map<bufferevent*, DuelPlayer> NetServer::users;
+std::vector<ServerShard*> NetServer::shards;
+thread_local ServerShard* NetServer::current_shard = 0;
 unsigned short NetServer::server_port = 0;
 event_base* NetServer::net_evbase = 0;
 event* NetServer::broadcast_ev = 0;
+event* NetServer::signal_ev[2] = {0, 0};
+event* NetServer::stats_ev = 0;
+char NetServer::stats_file[256] = "";
+int NetServer::stats_interval = 0;
+size_t NetServer::duelist_high_water = 0x800000;
+size_t NetServer::observer_high_water = 0x100000;
+bool NetServer::accept_seed = false;
 evconnlistener* NetServer::listener = 0;
-DuelMode* NetServer::duel_mode = 0;
-char NetServer::net_server_read[0x2000];
-char NetServer::net_server_write[0x2000];
-unsigned short NetServer::last_sent = 0;
+std::map<unsigned int, DuelMode*> NetServer::rooms;
+std::mutex NetServer::rooms_mutex;
+std::mutex NetServer::duel_mutex;
+unsigned int NetServer::next_room_id = 1;
+bool NetServer::dedicated = false;
+thread_local char NetServer::net_server_read[0x2000];
+thread_local char NetServer::net_server_write[0x2000];
+thread_local unsigned short NetServer::last_sent = 0;
+thread_local SharedPacket* NetServer::shared_packet = 0;
 
-bool NetServer::StartServer(unsigned short port) {
+bool NetServer::BindServer(unsigned short port, bool is_dedicated, unsigned int workers) {
 	if(net_evbase)
 		return false;
+	dedicated = is_dedicated;
 	net_evbase = event_base_new();
 	if(!net_evbase)
 		return false;
@@ -33,9 +52,81 @@ bool NetServer::StartServer(unsigned short port) {
 		return false;
 	}
 	evconnlistener_set_error_cb(listener, ServerAcceptError);
+	// shard 0 owns the listener; with workers the rooms live on shards 1..n
+	ServerShard* acceptor = new ServerShard();
+	acceptor->evbase = net_evbase;
+	shards.push_back(acceptor);
+	if(!dedicated)
+		workers = 0;
+	for(unsigned int i = 1; i <= workers; ++i) {
+		event_base* evbase = event_base_new();
+		if(!evbase)
+			break;
+		ServerShard* shard = new ServerShard();
+		shard->id = i;
+		shard->evbase = evbase;
+		shards.push_back(shard);
+		shard->thread = std::thread(ShardThread, shard);
+	}
+	return true;
+}
+bool NetServer::StartServer(unsigned short port, bool is_dedicated, unsigned int workers) {
+	if(!BindServer(port, is_dedicated, workers))
+		return false;
 	std::thread(ServerThread).detach();
 	return true;
 }
+int NetServer::RunServer(unsigned short port, unsigned int workers) {
+	if(!BindServer(port, true, workers))
+		return 1;
+	signal_ev[0] = evsignal_new(net_evbase, SIGINT, ServerSignal, NULL);
+	signal_ev[1] = evsignal_new(net_evbase, SIGTERM, ServerSignal, NULL);
+	event_add(signal_ev[0], NULL);
+	event_add(signal_ev[1], NULL);
+	if(stats_file[0] && stats_interval > 0) {
+		stats_ev = event_new(net_evbase, -1, EV_PERSIST, StatsTimer, NULL);
+		timeval timeout = {stats_interval, 0};
+		event_add(stats_ev, &timeout);
+	}
+	return ServerThread();
+}
+void NetServer::ServerSignal(evutil_socket_t fd, short events, void* arg) {
+	StopServer();
+}
+void NetServer::SetStatsFile(const char* file, int interval) {
+	strncpy(stats_file, file, sizeof(stats_file) - 1);
+	stats_file[sizeof(stats_file) - 1] = 0;
+	stats_interval = interval;
+}
+void NetServer::SetHighWater(size_t duelist, size_t observer) {
+	duelist_high_water = duelist;
+	observer_high_water = observer;
+}
+void NetServer::SetAcceptSeed(bool accept) {
+	accept_seed = accept;
+}
+void NetServer::StatsTimer(evutil_socket_t fd, short events, void* arg) {
+	std::vector<RoomStats> room_stats;
+	rooms_mutex.lock();
+	for(auto rit = rooms.begin(); rit != rooms.end(); ++rit) {
+		// other shards run these rooms, only ids fixed at creation and atomic fields are read
+		DuelMode* dm = rit->second;
+		RoomStats rs;
+		rs.id = dm->room_id;
+		rs.shard = dm->shard_id;
+		rs.stage = dm->duel_stage;
+		rs.engine_time = dm->engine_time;
+		rs.engine_max = dm->engine_max;
+		rs.engine_calls = dm->engine_calls;
+		room_stats.push_back(rs);
+	}
+	rooms_mutex.unlock();
+	int connections = 0;
+	for(auto sit = shards.begin(); sit != shards.end(); ++sit)
+		connections += (*sit)->load;
+	if(!ServerStats::WriteStats(stats_file, room_stats, connections))
+		fprintf(stderr, "Failed to write stats file %s\n", stats_file);
+}
 bool NetServer::StartBroadcast() {
 	if(!net_evbase)
 		return false;
@@ -58,9 +149,22 @@ bool NetServer::StartBroadcast() {
 void NetServer::StopServer() {
 	if(!net_evbase)
 		return;
-	if(duel_mode)
-		duel_mode->EndDuel();
-	event_base_loopexit(net_evbase, 0);
+	timeval tv = {0, 0};
+	for(auto sit = shards.begin(); sit != shards.end(); ++sit)
+		event_base_once((*sit)->evbase, -1, EV_TIMEOUT, StopShard, *sit, &tv);
+}
+void NetServer::StopShard(evutil_socket_t fd, short events, void* arg) {
+	ServerShard* shard = static_cast<ServerShard*>(arg);
+	std::vector<DuelMode*> owned;
+	rooms_mutex.lock();
+	for(auto rit = rooms.begin(); rit != rooms.end(); ++rit) {
+		if(rit->second->shard_id == shard->id)
+			owned.push_back(rit->second);
+	}
+	rooms_mutex.unlock();
+	for(auto dm : owned)
+		dm->EndDuel();
+	event_base_loopexit(shard->evbase, 0);
 }
 void NetServer::StopBroadcast() {
 	if(!net_evbase || !broadcast_ev)
@@ -73,6 +177,9 @@ void NetServer::StopBroadcast() {
 	broadcast_ev = 0;
 }
 void NetServer::StopListen() {
+	// a dedicated server keeps accepting players for its other rooms
+	if(dedicated)
+		return;
 	evconnlistener_disable(listener);
 	StopBroadcast();
 }
@@ -84,7 +191,9 @@ void NetServer::BroadcastEvent(evutil_socket_t fd, short events, void* arg) {
 	if(ret == -1)
 		return;
 	HostRequest* pHR = (HostRequest*)buf;
-	if(pHR->identifier == NETWORK_CLIENT_ID) {
+	std::lock_guard<std::mutex> lock(rooms_mutex);
+	if(pHR->identifier == NETWORK_CLIENT_ID && !rooms.empty()) {
+		DuelMode* duel_mode = rooms.begin()->second;
 		SOCKADDR_IN sockTo;
 		sockTo.sin_addr.s_addr = bc_addr.sin_addr.s_addr;
 		sockTo.sin_family = AF_INET;
@@ -99,12 +208,16 @@ void NetServer::BroadcastEvent(evutil_socket_t fd, short events, void* arg) {
 	}
 }
 void NetServer::ServerAccept(evconnlistener* listener, evutil_socket_t fd, sockaddr* address, int socklen, void* ctx) {
+	// packets are coalesced by FlushOutput, Nagle would only delay them
+	int nodelay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
 	bufferevent* bev = bufferevent_socket_new(net_evbase, fd, BEV_OPT_CLOSE_ON_FREE);
 	DuelPlayer dp;
 	dp.name[0] = 0;
 	dp.type = 0xff;
 	dp.bev = bev;
-	users[bev] = dp;
+	current_shard->users[bev] = dp;
+	current_shard->load++;
 	bufferevent_setcb(bev, ServerEchoRead, NULL, ServerEchoEvent, NULL);
 	bufferevent_enable(bev, EV_READ);
 }
@@ -122,14 +235,17 @@ void NetServer::ServerEchoRead(bufferevent *bev, void *ctx) {
 		if(len < (size_t)packet_len + 2)
 			return;
 		evbuffer_remove(input, net_server_read, packet_len + 2);
-		if(packet_len)
-			HandleCTOSPacket(&users[bev], &net_server_read[2], packet_len);
+		if(packet_len) {
+			if(HandoffPlayer(bev, net_server_read, packet_len + 2))
+				return;
+			HandleCTOSPacket(&current_shard->users[bev], &net_server_read[2], packet_len);
+		}
 		len -= packet_len + 2;
 	}
 }
 void NetServer::ServerEchoEvent(bufferevent* bev, short events, void* ctx) {
 	if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
-		DuelPlayer* dp = &users[bev];
+		DuelPlayer* dp = &current_shard->users[bev];
 		DuelMode* dm = dp->game;
 		if(dm)
 			dm->LeaveGame(dp);
@@ -137,12 +253,14 @@ void NetServer::ServerEchoEvent(bufferevent* bev, short events, void* ctx) {
 	}
 }
 int NetServer::ServerThread() {
+	current_shard = shards[0];
 	event_base_dispatch(net_evbase);
-	for(auto bit = users.begin(); bit != users.end(); ++bit) {
-		bufferevent_disable(bit->first, EV_READ);
-		bufferevent_free(bit->first);
+	for(size_t i = 1; i < shards.size(); ++i) {
+		event_base_loopexit(shards[i]->evbase, 0);
+		shards[i]->thread.join();
 	}
-	users.clear();
+	CloseShard(shards[0]);
+	ReplayWriter::Stop();
 	evconnlistener_free(listener);
 	listener = 0;
 	if(broadcast_ev) {
@@ -152,52 +270,356 @@ int NetServer::ServerThread() {
 		event_free(broadcast_ev);
 		broadcast_ev = 0;
 	}
-	if(duel_mode) {
-		event_free(duel_mode->etimer);
-		delete duel_mode;
+	for(int i = 0; i < 2; ++i) {
+		if(signal_ev[i]) {
+			event_free(signal_ev[i]);
+			signal_ev[i] = 0;
+		}
 	}
-	duel_mode = 0;
+	if(stats_ev) {
+		event_free(stats_ev);
+		stats_ev = 0;
+	}
+	for(size_t i = 1; i < shards.size(); ++i)
+		event_base_free(shards[i]->evbase);
+	for(auto sit = shards.begin(); sit != shards.end(); ++sit)
+		delete *sit;
+	shards.clear();
 	event_base_free(net_evbase);
 	net_evbase = 0;
 	return 0;
 }
+int NetServer::ShardThread(ServerShard* shard) {
+	current_shard = shard;
+	event_base_loop(shard->evbase, EVLOOP_NO_EXIT_ON_EMPTY);
+	CloseShard(shard);
+	return 0;
+}
+void NetServer::CloseShard(ServerShard* shard) {
+	DropSharedPacket();
+	for(auto bit = shard->users.begin(); bit != shard->users.end(); ++bit) {
+		bufferevent_disable(bit->first, EV_READ);
+		bufferevent_free(bit->first);
+	}
+	shard->users.clear();
+	for(auto hit = shard->held.begin(); hit != shard->held.end(); ++hit)
+		evbuffer_free(hit->second.second);
+	shard->held.clear();
+	std::lock_guard<std::mutex> lock(rooms_mutex);
+	for(auto rit = rooms.begin(); rit != rooms.end();) {
+		if(rit->second->shard_id != shard->id) {
+			++rit;
+			continue;
+		}
+		event_free(rit->second->etimer);
+		delete rit->second;
+		rit = rooms.erase(rit);
+	}
+}
+ServerShard* NetServer::PickShard(unsigned char pktType, char* data) {
+	if(pktType == CTOS_JOIN_GAME) {
+		CTOS_JoinGame* pkt = (CTOS_JoinGame*)data;
+		std::lock_guard<std::mutex> lock(rooms_mutex);
+		DuelMode* dm = FindRoom(pkt->gameid, pkt->pass);
+		if(!dm)
+			return 0;
+		return shards[dm->shard_id];
+	}
+	ServerShard* shard = shards[1];
+	for(size_t i = 2; i < shards.size(); ++i) {
+		if(shards[i]->load < shard->load)
+			shard = shards[i];
+	}
+	return shard;
+}
+bool NetServer::HandoffPlayer(bufferevent* bev, char* packet, unsigned int len) {
+	if(shards.size() < 2 || current_shard != shards[0])
+		return false;
+	DuelPlayer* dp = &current_shard->users[bev];
+	unsigned char pktType = packet[2];
+	if(dp->state || (pktType != CTOS_CREATE_GAME && pktType != CTOS_JOIN_GAME))
+		return false;
+	ServerShard* shard = PickShard(pktType, &packet[3]);
+	if(!shard)
+		return false;
+	PlayerHandoff* ho = new PlayerHandoff;
+	ho->fd = bufferevent_getfd(bev);
+	memcpy(ho->name, dp->name, sizeof(ho->name));
+	ho->shard = shard;
+	evbuffer* input = bufferevent_get_input(bev);
+	size_t rest = evbuffer_get_length(input);
+	ho->pending.resize(len + rest);
+	memcpy(&ho->pending[0], packet, len);
+	if(rest)
+		evbuffer_remove(input, &ho->pending[len], rest);
+	// detach the socket so that freeing the acceptor side keeps it open
+	bufferevent_disable(bev, EV_READ | EV_WRITE);
+	bufferevent_setfd(bev, -1);
+	bufferevent_free(bev);
+	current_shard->users.erase(bev);
+	current_shard->shed.erase(bev);
+	current_shard->load--;
+	shard->load++;
+	timeval tv = {0, 0};
+	event_base_once(shard->evbase, -1, EV_TIMEOUT, AcceptHandoff, ho, &tv);
+	return true;
+}
+void NetServer::AcceptHandoff(evutil_socket_t fd, short events, void* arg) {
+	PlayerHandoff* ho = static_cast<PlayerHandoff*>(arg);
+	bufferevent* bev = bufferevent_socket_new(current_shard->evbase, ho->fd, BEV_OPT_CLOSE_ON_FREE);
+	DuelPlayer dp;
+	memcpy(dp.name, ho->name, sizeof(dp.name));
+	dp.type = 0xff;
+	dp.bev = bev;
+	current_shard->users[bev] = dp;
+	bufferevent_setcb(bev, ServerEchoRead, NULL, ServerEchoEvent, NULL);
+	bufferevent_enable(bev, EV_READ);
+	// the tail of a socket input buffer is frozen outside of reads, prepend instead
+	evbuffer_prepend(bufferevent_get_input(bev), &ho->pending[0], ho->pending.size());
+	delete ho;
+	ServerEchoRead(bev, 0);
+}
+void NetServer::CorkOutput() {
+	current_shard->cork_depth++;
+}
+void NetServer::FlushOutput() {
+	if(--current_shard->cork_depth)
+		return;
+	for(auto cit = current_shard->corked.begin(); cit != current_shard->corked.end(); ++cit) {
+		evbuffer* output = bufferevent_get_output(cit->first);
+		evbuffer_add_buffer(output, cit->second);
+		ServerStats::output_depth.Add(evbuffer_get_length(output));
+		evbuffer_free(cit->second);
+		auto bit = current_shard->users.find(cit->first);
+		if(bit != current_shard->users.end())
+			CheckOutput(&bit->second, output);
+	}
+	current_shard->corked.clear();
+}
+void NetServer::HoldOutput(DuelPlayer* dp, DuelMode* dm) {
+	if(!dp || current_shard->held.count(dp->bev))
+		return;
+	current_shard->held[dp->bev] = std::make_pair(dm, evbuffer_new());
+}
+void NetServer::ReleaseOutput(DuelMode* dm, unsigned char proto, void* buffer, size_t len) {
+	std::vector<std::pair<bufferevent*, evbuffer*>> released;
+	for(auto hit = current_shard->held.begin(); hit != current_shard->held.end();) {
+		if(hit->second.first == dm) {
+			released.push_back(std::make_pair(hit->first, hit->second.second));
+			hit = current_shard->held.erase(hit);
+		} else
+			++hit;
+	}
+	// the packet goes out ahead of everything held back for the room, a null buffer only releases.
+	// A buffer longer than one packet is sent as STOC_REPLAY_PART packets followed by proto with the rest.
+	size_t max_len = sizeof(net_server_write) - 3;
+	for(size_t i = 0; i < released.size(); ++i) {
+		DuelPlayer* dp = &current_shard->users[released[i].first];
+		if(buffer) {
+			char* pbuf = (char*)buffer;
+			size_t left = len;
+			for(; left > max_len; pbuf += max_len, left -= max_len)
+				SendBufferToPlayer(dp, STOC_REPLAY_PART, pbuf, max_len);
+			SendBufferToPlayer(dp, proto, pbuf, left);
+		}
+		evbuffer_add_buffer(PlayerOutput(dp), released[i].second);
+		evbuffer_free(released[i].second);
+	}
+}
+void NetServer::CheckOutput(DuelPlayer* dp, evbuffer* output) {
+	// a host watching the duel owns the room, so only plain observers are shed early
+	bool observer = dp->game && dp->type == NETPLAYER_TYPE_OBSERVER && dp != dp->game->host_player;
+	size_t high_water = observer ? observer_high_water : duelist_high_water;
+	if(!high_water || evbuffer_get_length(output) <= high_water)
+		return;
+	// players are dropped from the loop, not while a duel is sending to them
+	if(!current_shard->shed.insert(dp->bev).second || current_shard->shed.size() > 1)
+		return;
+	timeval tv = {0, 0};
+	event_base_once(current_shard->evbase, -1, EV_TIMEOUT, ShedPlayers, 0, &tv);
+}
+void NetServer::ShedPlayers(evutil_socket_t fd, short events, void* arg) {
+	std::set<bufferevent*> shed;
+	shed.swap(current_shard->shed);
+	for(auto sit = shed.begin(); sit != shed.end(); ++sit) {
+		auto bit = current_shard->users.find(*sit);
+		if(bit == current_shard->users.end())
+			continue;
+		DuelPlayer* dp = &bit->second;
+		bool observer = dp->game && dp->type == NETPLAYER_TYPE_OBSERVER && dp != dp->game->host_player;
+		if(observer)
+			ServerStats::shed_observers++;
+		else
+			ServerStats::shed_duelists++;
+		// the queued output is dropped along with the connection
+		evbuffer_drain(bufferevent_get_output(dp->bev), evbuffer_get_length(bufferevent_get_output(dp->bev)));
+		if(dp->game)
+			dp->game->LeaveGame(dp);
+		else
+			DisconnectPlayer(dp);
+	}
+}
 void NetServer::DisconnectPlayer(DuelPlayer* dp) {
-	auto bit = users.find(dp->bev);
-	if(bit != users.end()) {
+	current_shard->shed.erase(dp->bev);
+	auto cit = current_shard->corked.find(dp->bev);
+	if(cit != current_shard->corked.end()) {
+		evbuffer_add_buffer(bufferevent_get_output(dp->bev), cit->second);
+		evbuffer_free(cit->second);
+		current_shard->corked.erase(cit);
+	}
+	auto hit = current_shard->held.find(dp->bev);
+	if(hit != current_shard->held.end()) {
+		evbuffer_add_buffer(bufferevent_get_output(dp->bev), hit->second.second);
+		evbuffer_free(hit->second.second);
+		current_shard->held.erase(hit);
+	}
+	auto bit = current_shard->users.find(dp->bev);
+	if(bit != current_shard->users.end()) {
 		bufferevent_flush(dp->bev, EV_WRITE, BEV_FLUSH);
 		bufferevent_disable(dp->bev, EV_READ);
 		bufferevent_free(dp->bev);
-		users.erase(bit);
+		current_shard->users.erase(bit);
+		current_shard->load--;
 	}
 }
+DuelMode* NetServer::CreateRoom(CTOS_CreateGame* pkt) {
+	if(pkt->info.rule > 3)
+		pkt->info.rule = 0;
+	if(pkt->info.mode > 2)
+		pkt->info.mode = 0;
+	DuelMode* dm = 0;
+	event_base* evbase = current_shard->evbase;
+	if(pkt->info.mode == MODE_SINGLE) {
+		dm = new SingleDuel(false);
+		dm->etimer = event_new(evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, dm);
+	} else if(pkt->info.mode == MODE_MATCH) {
+		dm = new SingleDuel(true);
+		dm->etimer = event_new(evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, dm);
+	} else {
+		dm = new TagDuel();
+		dm->etimer = event_new(evbase, 0, EV_TIMEOUT | EV_PERSIST, TagDuel::TagTimer, dm);
+	}
+	unsigned int hash = 1;
+	for(auto lfit = deckManager._lfList.begin(); lfit != deckManager._lfList.end(); ++lfit) {
+		if(pkt->info.lflist == lfit->hash) {
+			hash = pkt->info.lflist;
+			break;
+		}
+	}
+	if(hash == 1)
+		pkt->info.lflist = deckManager._lfList[0].hash;
+	dm->host_info = pkt->info;
+	BufferIO::CopyWStr(pkt->name, dm->name, 20);
+	BufferIO::CopyWStr(pkt->pass, dm->pass, 20);
+	dm->shard_id = current_shard->id;
+	rooms_mutex.lock();
+	dm->room_id = next_room_id++;
+	if(!next_room_id)
+		next_room_id = 1;
+	rooms[dm->room_id] = dm;
+	rooms_mutex.unlock();
+	return dm;
+}
+DuelMode* NetServer::FindRoom(unsigned int gameid, unsigned short* pass) {
+	// the caller holds rooms_mutex; a worker shard only sees its own rooms
+	unsigned int shard_id = current_shard->id;
+	if(gameid) {
+		auto rit = rooms.find(gameid);
+		if(rit == rooms.end() || (shard_id && rit->second->shard_id != shard_id))
+			return 0;
+		return rit->second;
+	}
+	if(rooms.empty())
+		return 0;
+	if(!dedicated)
+		return rooms.begin()->second;
+	// gameid 0: the first waiting room with a matching password,
+	// pass is written before the room is published and duel_stage is atomic
+	wchar_t jpass[20];
+	BufferIO::CopyWStr(pass, jpass, 20);
+	for(auto rit = rooms.begin(); rit != rooms.end(); ++rit) {
+		if(shard_id && rit->second->shard_id != shard_id)
+			continue;
+		if(rit->second->duel_stage == DUEL_STAGE_BEGIN && !wcscmp(rit->second->pass, jpass))
+			return rit->second;
+	}
+	return 0;
+}
+void NetServer::CloseRoom(DuelMode* dm) {
+	if(!dedicated) {
+		StopServer();
+		return;
+	}
+	rooms_mutex.lock();
+	size_t erased = rooms.erase(dm->room_id);
+	rooms_mutex.unlock();
+	if(!erased)
+		return;
+	event_del(dm->etimer);
+	std::vector<DuelPlayer*> members;
+	for(auto bit = current_shard->users.begin(); bit != current_shard->users.end(); ++bit) {
+		if(bit->second.game == dm)
+			members.push_back(&bit->second);
+	}
+	for(auto dp : members)
+		DisconnectPlayer(dp);
+	// the room is still on the call stack, free it from the event loop
+	timeval tv = {0, 0};
+	event_base_once(current_shard->evbase, -1, EV_TIMEOUT, ReleaseRoom, dm, &tv);
+}
+void NetServer::ReleaseRoom(evutil_socket_t fd, short events, void* arg) {
+	DuelMode* dm = static_cast<DuelMode*>(arg);
+	event_free(dm->etimer);
+	delete dm;
+}
+SharedPacket* NetServer::CreateSharedPacket(const char* data, unsigned short len) {
+	SharedPacket* sp = (SharedPacket*)malloc(sizeof(SharedPacket) + len);
+	sp->refs = 1;
+	sp->len = len;
+	memcpy(sp->data, data, len);
+	return sp;
+}
+void NetServer::ReleaseSharedPacket(const void* data, size_t datalen, void* extra) {
+	// every reference lives on the shard that created the packet
+	SharedPacket* sp = static_cast<SharedPacket*>(extra);
+	if(--sp->refs == 0)
+		free(sp);
+}
 void NetServer::HandleCTOSPacket(DuelPlayer* dp, char* data, unsigned int len) {
 	char* pdata = data;
 	unsigned char pktType = BufferIO::ReadUInt8(pdata);
-	if((pktType != CTOS_SURRENDER) && (pktType != CTOS_CHAT) && (dp->state == 0xff || (dp->state && dp->state != pktType)))
+	if((pktType != CTOS_SURRENDER) && (pktType != CTOS_CHAT) && (pktType != CTOS_REQUEST_FIELD) && (dp->state == 0xff || (dp->state && dp->state != pktType)))
 		return;
 	switch(pktType) {
 	case CTOS_RESPONSE: {
-		if(!dp->game || !duel_mode->pduel)
+		if(!dp->game || !dp->game->pduel)
 			return;
-		duel_mode->GetResponse(dp, pdata, len > 64 ? 64 : len - 1);
+		dp->game->GetResponse(dp, pdata, len > 64 ? 64 : len - 1);
 		break;
 	}
 	case CTOS_TIME_CONFIRM: {
-		if(!dp->game || !duel_mode->pduel)
+		if(!dp->game || !dp->game->pduel)
 			return;
-		duel_mode->TimeConfirm(dp);
+		dp->game->TimeConfirm(dp);
+		break;
+	}
+	case CTOS_REQUEST_FIELD: {
+		if(!dp->game || !dp->game->pduel || len < 1 + sizeof(CTOS_RequestField))
+			return;
+		CTOS_RequestField* pkt = (CTOS_RequestField*)pdata;
+		dp->game->RequestField(dp, pkt->player, pkt->location);
 		break;
 	}
 	case CTOS_CHAT: {
 		if(!dp->game)
 			return;
-		duel_mode->Chat(dp, pdata, len - 1);
+		dp->game->Chat(dp, pdata, len - 1);
 		break;
 	}
 	case CTOS_UPDATE_DECK: {
 		if(!dp->game)
 			return;
-		duel_mode->UpdateDeck(dp, pdata, len - 1);
+		dp->game->UpdateDeck(dp, pdata, len - 1);
 		break;
 	}
 	case CTOS_HAND_RESULT: {
@@ -220,87 +642,86 @@ void NetServer::HandleCTOSPacket(DuelPlayer* dp, char* data, unsigned int len) {
 		break;
 	}
 	case CTOS_CREATE_GAME: {
-		if(dp->game || duel_mode)
+		if(dp->game || (!dedicated && !rooms.empty()))
 			return;
 		CTOS_CreateGame* pkt = (CTOS_CreateGame*)pdata;
-		if(pkt->info.mode == MODE_SINGLE) {
-			duel_mode = new SingleDuel(false);
-			duel_mode->etimer = event_new(net_evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, duel_mode);
-		} else if(pkt->info.mode == MODE_MATCH) {
-			duel_mode = new SingleDuel(true);
-			duel_mode->etimer = event_new(net_evbase, 0, EV_TIMEOUT | EV_PERSIST, SingleDuel::SingleTimer, duel_mode);
-		} else if(pkt->info.mode == MODE_TAG) {
-			duel_mode = new TagDuel();
-			duel_mode->etimer = event_new(net_evbase, 0, EV_TIMEOUT | EV_PERSIST, TagDuel::TagTimer, duel_mode);
-		}
-		if(pkt->info.rule > 3)
-			pkt->info.rule = 0;
-		if(pkt->info.mode > 2)
-			pkt->info.mode = 0;
-		unsigned int hash = 1;
-		for(auto lfit = deckManager._lfList.begin(); lfit != deckManager._lfList.end(); ++lfit) {
-			if(pkt->info.lflist == lfit->hash) {
-				hash = pkt->info.lflist;
-				break;
-			}
-		}
-		if(hash == 1)
-			pkt->info.lflist = deckManager._lfList[0].hash;
-		duel_mode->host_info = pkt->info;
-		BufferIO::CopyWStr(pkt->name, duel_mode->name, 20);
-		BufferIO::CopyWStr(pkt->pass, duel_mode->pass, 20);
-		duel_mode->JoinGame(dp, 0, true);
-		StartBroadcast();
+		DuelMode* dm = CreateRoom(pkt);
+		dm->JoinGame(dp, 0, true);
+		STOC_CreateGame sccg;
+		sccg.gameid = dm->room_id;
+		SendPacketToPlayer(dp, STOC_CREATE_GAME, sccg);
+		if(!dedicated)
+			StartBroadcast();
 		break;
 	}
 	case CTOS_JOIN_GAME: {
-		if(!duel_mode)
+		CTOS_JoinGame* pkt = (CTOS_JoinGame*)pdata;
+		rooms_mutex.lock();
+		DuelMode* dm = FindRoom(pkt->gameid, pkt->pass);
+		rooms_mutex.unlock();
+		// the acceptor sees the rooms of every worker, a room opened there since PickShard is not joined from here
+		if(!dm || dm->shard_id != current_shard->id) {
+			STOC_ErrorMsg scem;
+			scem.msg = ERRMSG_JOINERROR;
+			scem.code = 0;
+			SendPacketToPlayer(dp, STOC_ERROR_MSG, scem);
 			break;
-		duel_mode->JoinGame(dp, pdata, false);
+		}
+		dm->JoinGame(dp, pdata, false);
 		break;
 	}
 	case CTOS_LEAVE_GAME: {
-		if(!duel_mode)
+		if(!dp->game)
 			break;
-		duel_mode->LeaveGame(dp);
+		dp->game->LeaveGame(dp);
 		break;
 	}
 	case CTOS_SURRENDER: {
-		if(!duel_mode)
+		if(!dp->game)
 			break;
-		duel_mode->Surrender(dp);
+		dp->game->Surrender(dp);
 		break;
 	}
 	case CTOS_HS_TODUELIST: {
-		if(!duel_mode || duel_mode->pduel)
+		if(!dp->game || dp->game->pduel)
 			break;
-		duel_mode->ToDuelist(dp);
+		dp->game->ToDuelist(dp);
 		break;
 	}
 	case CTOS_HS_TOOBSERVER: {
-		if(!duel_mode || duel_mode->pduel)
+		if(!dp->game || dp->game->pduel)
 			break;
-		duel_mode->ToObserver(dp);
+		dp->game->ToObserver(dp);
 		break;
 	}
 	case CTOS_HS_READY:
 	case CTOS_HS_NOTREADY: {
-		if(!duel_mode || duel_mode->pduel)
+		if(!dp->game || dp->game->pduel)
 			break;
-		duel_mode->PlayerReady(dp, (CTOS_HS_NOTREADY - pktType) != 0);
+		dp->game->PlayerReady(dp, (CTOS_HS_NOTREADY - pktType) != 0);
 		break;
 	}
 	case CTOS_HS_KICK: {
-		if(!duel_mode || duel_mode->pduel)
+		if(!dp->game || dp->game->pduel)
 			break;
 		CTOS_Kick* pkt = (CTOS_Kick*)pdata;
-		duel_mode->PlayerKick(dp, pkt->pos);
+		dp->game->PlayerKick(dp, pkt->pos);
 		break;
 	}
 	case CTOS_HS_START: {
-		if(!duel_mode || duel_mode->pduel)
+		if(!dp->game || dp->game->pduel)
+			break;
+		dp->game->StartDuel(dp);
+		break;
+	}
+	case CTOS_DUEL_SEED: {
+		// for load tests with recorded duels, never on a public server
+		if(!accept_seed || !dp->game || dp->game->pduel || dp != dp->game->host_player || len < 1 + sizeof(CTOS_DuelSeed))
 			break;
-		duel_mode->StartDuel(dp);
+		CTOS_DuelSeed* pkt = (CTOS_DuelSeed*)pdata;
+		dp->game->has_seed = true;
+		dp->game->seed = pkt->seed;
+		dp->game->seed_options = pkt->options;
 		break;
 	}
 	}
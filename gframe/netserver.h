@@ -5,25 +5,77 @@
 #include "network.h"
 #include "data_manager.h"
 #include "deck_manager.h"
+#include "server_stats.h"
 #include <set>
+#include <map>
+#include <vector>
+#include <atomic>
 #include <unordered_map>
 
 namespace ygo {
 
+struct ServerShard {
+	unsigned int id;
+	event_base* evbase;
+	std::thread thread;
+	std::unordered_map<bufferevent*, DuelPlayer> users;
+	std::unordered_map<bufferevent*, evbuffer*> corked;
+	std::set<bufferevent*> shed;
+	std::unordered_map<bufferevent*, std::pair<DuelMode*, evbuffer*>> held;
+	int cork_depth;
+	std::atomic<int> load;
+	ServerShard(): id(0), evbase(0), cork_depth(0), load(0) {}
+};
+
+// a serialized packet shared by the output buffers of several players
+struct SharedPacket {
+	int refs;
+	unsigned short len;
+	char data[1];
+};
+
+struct PlayerHandoff {
+	evutil_socket_t fd;
+	unsigned short name[20];
+	std::vector<char> pending;
+	ServerShard* shard;
+};
+
 class NetServer {
 private:
-	static std::unordered_map<bufferevent*, DuelPlayer> users;
+	static std::vector<ServerShard*> shards;
+	static thread_local ServerShard* current_shard;
 	static unsigned short server_port;
 	static event_base* net_evbase;
 	static event* broadcast_ev;
+	static event* signal_ev[2];
+	static event* stats_ev;
+	static char stats_file[256];
+	static int stats_interval;
+	static size_t duelist_high_water;
+	static size_t observer_high_water;
+	static bool accept_seed;
 	static evconnlistener* listener;
-	static DuelMode* duel_mode;
-	static char net_server_read[0x2000];
-	static char net_server_write[0x2000];
-	static unsigned short last_sent;
+	static std::map<unsigned int, DuelMode*> rooms;
+	static std::mutex rooms_mutex;
+	static unsigned int next_room_id;
+	static bool dedicated;
+	static thread_local char net_server_read[0x2000];
+	static thread_local char net_server_write[0x2000];
+	static thread_local unsigned short last_sent;
+	static thread_local SharedPacket* shared_packet;
 
 public:
-	static bool StartServer(unsigned short port);
+	static std::mutex duel_mutex;
+
+	static bool BindServer(unsigned short port, bool is_dedicated, unsigned int workers);
+	static bool StartServer(unsigned short port, bool is_dedicated = false, unsigned int workers = 0);
+	static int RunServer(unsigned short port, unsigned int workers);
+	static void ServerSignal(evutil_socket_t fd, short events, void* arg);
+	static void SetStatsFile(const char* file, int interval);
+	static void StatsTimer(evutil_socket_t fd, short events, void* arg);
+	static void SetHighWater(size_t duelist, size_t observer);
+	static void SetAcceptSeed(bool accept);
 	static bool StartBroadcast();
 	static void StopServer();
 	static void StopBroadcast();
@@ -34,39 +86,97 @@ public:
 	static void ServerEchoRead(bufferevent* bev, void* ctx);
 	static void ServerEchoEvent(bufferevent* bev, short events, void* ctx);
 	static int ServerThread();
+	static int ShardThread(ServerShard* shard);
+	static void StopShard(evutil_socket_t fd, short events, void* arg);
+	static void CloseShard(ServerShard* shard);
+	static ServerShard* PickShard(unsigned char pktType, char* data);
+	static bool HandoffPlayer(bufferevent* bev, char* packet, unsigned int len);
+	static void AcceptHandoff(evutil_socket_t fd, short events, void* arg);
 	static void DisconnectPlayer(DuelPlayer* dp);
+	static DuelMode* CreateRoom(CTOS_CreateGame* pkt);
+	static DuelMode* FindRoom(unsigned int gameid, unsigned short* pass);
+	static void CloseRoom(DuelMode* dm);
+	static void ReleaseRoom(evutil_socket_t fd, short events, void* arg);
 	static void HandleCTOSPacket(DuelPlayer* dp, char* data, unsigned int len);
+	static SharedPacket* CreateSharedPacket(const char* data, unsigned short len);
+	static void ReleaseSharedPacket(const void* data, size_t datalen, void* extra);
+	static void CorkOutput();
+	static void FlushOutput();
+	static void CheckOutput(DuelPlayer* dp, evbuffer* output);
+	static void ShedPlayers(evutil_socket_t fd, short events, void* arg);
+	static void HoldOutput(DuelPlayer* dp, DuelMode* dm);
+	static void ReleaseOutput(DuelMode* dm, unsigned char proto, void* buffer, size_t len);
+	static evbuffer* PlayerOutput(DuelPlayer* dp) {
+		if(!current_shard->held.empty()) {
+			auto hit = current_shard->held.find(dp->bev);
+			if(hit != current_shard->held.end())
+				return hit->second.second;
+		}
+		if(!current_shard->cork_depth) {
+			evbuffer* output = bufferevent_get_output(dp->bev);
+			CheckOutput(dp, output);
+			return output;
+		}
+		evbuffer*& buf = current_shard->corked[dp->bev];
+		if(!buf)
+			buf = evbuffer_new();
+		return buf;
+	}
+	static void DropSharedPacket() {
+		if(shared_packet) {
+			ReleaseSharedPacket(0, 0, shared_packet);
+			shared_packet = 0;
+		}
+	}
 	static void SendPacketToPlayer(DuelPlayer* dp, unsigned char proto) {
+		DropSharedPacket();
 		char* p = net_server_write;
 		BufferIO::WriteInt16(p, 1);
 		BufferIO::WriteInt8(p, proto);
 		last_sent = 3;
 		if(!dp)
 			return;
-		bufferevent_write(dp->bev, net_server_write, last_sent);
+		ServerStats::CountPacket(proto, last_sent);
+		evbuffer_add(PlayerOutput(dp), net_server_write, last_sent);
 	}
 	template<typename ST>
 	static void SendPacketToPlayer(DuelPlayer* dp, unsigned char proto, ST& st) {
+		DropSharedPacket();
 		char* p = net_server_write;
 		BufferIO::WriteInt16(p, 1 + sizeof(ST));
 		BufferIO::WriteInt8(p, proto);
 		memcpy(p, &st, sizeof(ST));
 		last_sent = sizeof(ST) + 3;
-		if(dp)
-			bufferevent_write(dp->bev, net_server_write, last_sent);
+		if(!dp)
+			return;
+		ServerStats::CountPacket(proto, last_sent);
+		evbuffer_add(PlayerOutput(dp), net_server_write, last_sent);
 	}
 	static void SendBufferToPlayer(DuelPlayer* dp, unsigned char proto, void* buffer, size_t len) {
+		DropSharedPacket();
 		char* p = net_server_write;
 		BufferIO::WriteInt16(p, 1 + len);
 		BufferIO::WriteInt8(p, proto);
 		memcpy(p, buffer, len);
 		last_sent = len + 3;
-		if(dp)
-			bufferevent_write(dp->bev, net_server_write, last_sent);
+		if(!dp)
+			return;
+		ServerStats::CountPacket(proto, last_sent);
+		evbuffer_add(PlayerOutput(dp), net_server_write, last_sent);
 	}
 	static void ReSendToPlayer(DuelPlayer* dp) {
-		if(dp)
-			bufferevent_write(dp->bev, net_server_write, last_sent);
+		if(!dp)
+			return;
+		ServerStats::CountPacket(net_server_write[2], last_sent);
+		// small packets are cheaper to copy than to reference
+		if(last_sent < 128) {
+			evbuffer_add(PlayerOutput(dp), net_server_write, last_sent);
+			return;
+		}
+		if(!shared_packet)
+			shared_packet = CreateSharedPacket(net_server_write, last_sent);
+		shared_packet->refs++;
+		evbuffer_add_reference(PlayerOutput(dp), shared_packet->data, shared_packet->len, ReleaseSharedPacket, shared_packet);
 	}
 };
 
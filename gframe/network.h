@@ -8,6 +8,7 @@
 #include <event2/bufferevent.h>
 #include <event2/buffer.h>
 #include <event2/thread.h>
+#include <atomic>
 
 namespace ygo {
 
@@ -56,6 +57,14 @@ struct CTOS_JoinGame {
 struct CTOS_Kick {
 	unsigned char pos;
 };
+struct CTOS_DuelSeed {
+	unsigned int seed;
+	unsigned int options;
+};
+struct CTOS_RequestField {
+	unsigned char player;
+	unsigned char location;
+};
 struct STOC_ErrorMsg {
 	unsigned char msg;
 	unsigned int code;
@@ -121,7 +130,7 @@ struct DuelPlayer {
 
 class DuelMode {
 public:
-	DuelMode(): host_player(0), pduel(0), duel_stage(0) {}
+	DuelMode(): etimer(0), host_player(0), duel_stage(0), pduel(0), room_id(0), shard_id(0), has_seed(false), seed(0), seed_options(0), engine_time(0), engine_max(0), engine_calls(0) {}
 	virtual ~DuelMode() {}
 	virtual void Chat(DuelPlayer* dp, void* pdata, int len) {}
 	virtual void JoinGame(DuelPlayer* dp, void* pdata, bool is_creater) {}
@@ -141,14 +150,25 @@ public:
 	virtual void Surrender(DuelPlayer* dp) {}
 	virtual void GetResponse(DuelPlayer* dp, void* pdata, unsigned int len) {}
 	virtual void TimeConfirm(DuelPlayer* dp) {}
+	virtual void RequestField(DuelPlayer* dp, unsigned char player, unsigned char location) {}
 	virtual void EndDuel() {};
 
 public:
 	event* etimer;
 	DuelPlayer* host_player;
 	HostInfo host_info;
-	int duel_stage;
+	// changed by the room's shard, read by other shards looking for a room to join
+	std::atomic<int> duel_stage;
 	unsigned long pduel;
+	unsigned int room_id;
+	unsigned int shard_id;
+	// set by CTOS_DUEL_SEED when the server accepts it, the duels then replay a recorded seed and duel options
+	bool has_seed;
+	unsigned int seed;
+	unsigned int seed_options;
+	std::atomic<unsigned long long> engine_time;
+	std::atomic<unsigned long long> engine_max;
+	std::atomic<unsigned long long> engine_calls;
 	wchar_t name[20];
 	wchar_t pass[20];
 };
@@ -170,6 +190,7 @@ public:
 #define CTOS_UPDATE_DECK	0x2
 #define CTOS_HAND_RESULT	0x3
 #define CTOS_TP_RESULT		0x4
+#define CTOS_REQUEST_FIELD	0x5
 #define CTOS_PLAYER_INFO	0x10
 #define CTOS_CREATE_GAME	0x11
 #define CTOS_JOIN_GAME		0x12
@@ -183,6 +204,7 @@ public:
 #define CTOS_HS_NOTREADY	0x23
 #define CTOS_HS_KICK		0x24
 #define CTOS_HS_START		0x25
+#define CTOS_DUEL_SEED		0x30
 
 #define STOC_GAME_MSG		0x1
 #define STOC_ERROR_MSG		0x2
@@ -201,6 +223,7 @@ public:
 #define STOC_REPLAY			0x17
 #define STOC_TIME_LIMIT		0x18
 #define STOC_CHAT			0x19
+#define STOC_REPLAY_PART	0x1a
 #define STOC_HS_PLAYER_ENTER	0x20
 #define STOC_HS_PLAYER_CHANGE	0x21
 #define STOC_HS_WATCH_CHANGE	0x22
@@ -4,7 +4,7 @@ project "ygopro"
     kind "WindowedApp"
 
     files { "**.cpp", "**.cc", "**.c", "**.h" }
-    excludes "lzma/**"
+    excludes { "lzma/**", "ygoserver.cpp", "ygoloadgen.cpp", "ygoverify.cpp" }
     includedirs { "../ocgcore" }
     links { "ocgcore", "clzma", "Irrlicht", "freetype", "sqlite3", "lua" , "event" }
 
@@ -39,3 +39,53 @@ project "ygopro"
             libdirs { "../irrklang/bin/linux-gcc-64" }
             includedirs { "../irrklang/include" }
         end
+
+project "ygoserver"
+    kind "ConsoleApp"
+
+    files { "ygoserver.cpp", "netserver.cpp", "single_duel.cpp", "tag_duel.cpp",
+            "deck_manager.cpp", "data_manager.cpp", "replay.cpp", "replay_writer.cpp",
+            "query_cache.cpp", "script_cache.cpp", "server_stats.cpp" }
+    defines { "YGOPRO_SERVER_MODE" }
+    includedirs { "../ocgcore" }
+    links { "ocgcore", "clzma", "sqlite3", "lua", "event" }
+
+    configuration "windows"
+        includedirs { "../event/include", "../sqlite3" }
+        links { "ws2_32" }
+    configuration "not vs*"
+        buildoptions { "-std=c++14", "-fno-rtti" }
+    configuration "not windows"
+        links { "event_pthreads", "dl", "pthread" }
+
+project "ygoloadgen"
+    kind "ConsoleApp"
+
+    files { "ygoloadgen.cpp", "replay.cpp", "replay_writer.cpp", "server_stats.cpp" }
+    defines { "YGOPRO_SERVER_MODE" }
+    includedirs { "../ocgcore" }
+    links { "clzma", "event" }
+
+    configuration "windows"
+        includedirs { "../event/include", "../sqlite3" }
+        links { "ws2_32" }
+    configuration "not vs*"
+        buildoptions { "-std=c++14", "-fno-rtti" }
+    configuration "not windows"
+        links { "event_pthreads", "pthread" }
+
+project "ygoverify"
+    kind "ConsoleApp"
+
+    files { "ygoverify.cpp", "data_manager.cpp", "replay.cpp", "replay_writer.cpp", "script_cache.cpp", "server_stats.cpp" }
+    defines { "YGOPRO_SERVER_MODE" }
+    includedirs { "../ocgcore" }
+    links { "ocgcore", "clzma", "sqlite3", "lua", "event" }
+
+    configuration "windows"
+        includedirs { "../event/include", "../sqlite3" }
+        links { "ws2_32" }
+    configuration "not vs*"
+        buildoptions { "-std=c++14", "-fno-rtti" }
+    configuration "not windows"
+        links { "event_pthreads", "dl", "pthread" }
@@ -0,0 +1,261 @@
+#include "query_cache.h"
+
+namespace ygo {
+
+// fields the client knows how to read, see ClientCard::UpdateInfo
+static const unsigned int QUERY_DELTA_MASK = 0xefffff;
+
+void QueryCache::Clear() {
+	cards.clear();
+	resynced.clear();
+}
+int QueryCache::WriteUpdate(char* msg, int len, char* buf) {
+	int player = (unsigned char)msg[1];
+	int location = (unsigned char)msg[2];
+	char* qbuf = msg + 3;
+	char* qend = msg + len;
+	char* pbuf = buf;
+	BufferIO::WriteInt8(pbuf, MSG_UPDATE_DATA_DELTA);
+	BufferIO::WriteInt8(pbuf, player);
+	BufferIO::WriteInt8(pbuf, location);
+	char* field[32];
+	int size[32];
+	char* cached[32];
+	int csize[32];
+	bool full = false;
+	for(size_t i = 0; qbuf < qend; ++i) {
+		char* pdata = qbuf;
+		int clen = BufferIO::ReadInt32(pdata);
+		if(clen < 4 || clen > qend - qbuf) {
+			full = true;
+			break;
+		}
+		qbuf += clen;
+		unsigned int flag = (clen >= 8) ? BufferIO::ReadInt32(pdata) : 0;
+		if(!flag) {
+			if(pbuf - buf + 8 > len)
+				full = true;
+			if(!full) {
+				BufferIO::WriteInt32(pbuf, (clen == 4) ? 4 : 8);
+				if(clen != 4)
+					BufferIO::WriteInt32(pbuf, 0);
+			}
+			continue;
+		}
+		CardQuery& card = GetCard(player, location, i);
+		if(!ParseQuery(flag, pdata, clen - 8, field, size)) {
+			card.flag = 0;
+			card.data.clear();
+			full = true;
+			continue;
+		}
+		ParseQuery(card.flag, card.data.data(), (int)card.data.size(), cached, csize);
+		unsigned int changed = 0;
+		int dlen = 12;
+		for(int b = 0; b < 32; ++b) {
+			unsigned int bit = 1U << b;
+			if(!(flag & bit))
+				continue;
+			if((card.flag & bit) && csize[b] == size[b] && !memcmp(cached[b], field[b], size[b]))
+				continue;
+			changed |= bit;
+			dlen += size[b];
+		}
+		if(pbuf - buf + dlen > len)
+			full = true;
+		if(!full) {
+			BufferIO::WriteInt32(pbuf, dlen);
+			BufferIO::WriteInt32(pbuf, flag);
+			BufferIO::WriteInt32(pbuf, changed);
+			for(int b = 0; b < 32; ++b) {
+				if(changed & (1U << b)) {
+					memcpy(pbuf, field[b], size[b]);
+					pbuf += size[b];
+				}
+			}
+		}
+		MergeQuery(card, flag, field, size);
+	}
+	if(full || pbuf - buf >= len) {
+		memcpy(buf, msg, len);
+		return len;
+	}
+	return (int)(pbuf - buf);
+}
+void QueryCache::StoreUpdate(char* msg, int len) {
+	int player = (unsigned char)msg[1];
+	int location = (unsigned char)msg[2];
+	char* qbuf = msg + 3;
+	char* qend = msg + len;
+	char* field[32];
+	int size[32];
+	for(size_t i = 0; qbuf < qend; ++i) {
+		char* pdata = qbuf;
+		int clen = BufferIO::ReadInt32(pdata);
+		if(clen < 4 || clen > qend - qbuf)
+			break;
+		qbuf += clen;
+		unsigned int flag = (clen >= 8) ? BufferIO::ReadInt32(pdata) : 0;
+		if(!flag)
+			continue;
+		CardQuery& card = GetCard(player, location, i);
+		if(!ParseQuery(flag, pdata, clen - 8, field, size)) {
+			card.flag = 0;
+			card.data.clear();
+			continue;
+		}
+		MergeQuery(card, flag, field, size);
+	}
+}
+int QueryCache::ReadDelta(char* msg, int len, char* buf, int maxlen) {
+	if(len < 3 || maxlen < 3)
+		return 0;
+	int player = (unsigned char)msg[1];
+	int location = (unsigned char)msg[2];
+	char* dbuf = msg + 3;
+	char* dend = msg + len;
+	char* pbuf = buf;
+	BufferIO::WriteInt8(pbuf, MSG_UPDATE_DATA);
+	BufferIO::WriteInt8(pbuf, player);
+	BufferIO::WriteInt8(pbuf, location);
+	char* field[32];
+	int size[32];
+	char* cached[32];
+	int csize[32];
+	for(size_t i = 0; dbuf < dend; ++i) {
+		char* pdata = dbuf;
+		if(dend - dbuf < 4)
+			return 0;
+		int clen = BufferIO::ReadInt32(pdata);
+		if(clen < 4 || clen > dend - dbuf)
+			return 0;
+		dbuf += clen;
+		if(clen < 12) {
+			if((clen != 4 && clen != 8) || pbuf - buf + clen > maxlen)
+				return 0;
+			memcpy(pbuf, dbuf - clen, clen);
+			pbuf += clen;
+			continue;
+		}
+		unsigned int flag = BufferIO::ReadInt32(pdata);
+		unsigned int changed = BufferIO::ReadInt32(pdata);
+		CardQuery& card = GetCard(player, location, i);
+		if((changed & ~flag) || (flag & ~changed & ~card.flag) || !ParseQuery(changed, pdata, clen - 12, field, size))
+			return 0;
+		ParseQuery(card.flag, card.data.data(), (int)card.data.size(), cached, csize);
+		int rlen = 8;
+		for(int b = 0; b < 32; ++b) {
+			unsigned int bit = 1U << b;
+			if(changed & bit)
+				rlen += size[b];
+			else if(flag & bit)
+				rlen += csize[b];
+		}
+		if(pbuf - buf + rlen > maxlen)
+			return 0;
+		char* prec = pbuf;
+		pbuf += 4;
+		BufferIO::WriteInt32(pbuf, flag);
+		for(int b = 0; b < 32; ++b) {
+			unsigned int bit = 1U << b;
+			if(changed & bit) {
+				memcpy(pbuf, field[b], size[b]);
+				pbuf += size[b];
+			} else if(flag & bit) {
+				memcpy(pbuf, cached[b], csize[b]);
+				pbuf += csize[b];
+			}
+		}
+		BufferIO::WriteInt32(prec, (int)(pbuf - prec));
+		MergeQuery(card, changed, field, size);
+	}
+	return (int)(pbuf - buf);
+}
+void QueryCache::Invalidate(int player, int location) {
+	cards.erase((player << 8) | location);
+}
+bool QueryCache::Resync(int player, int location) {
+	if(!resynced.insert((player << 8) | location).second)
+		return false;
+	Invalidate(player, location);
+	return true;
+}
+int QueryCache::PublicView(char* msg, int len, char* buf) {
+	memcpy(buf, msg, len);
+	int location = (unsigned char)buf[2];
+	char* qbuf = buf + 3;
+	char* qend = buf + len;
+	while(qbuf < qend) {
+		char* pdata = qbuf;
+		int clen = BufferIO::ReadInt32(pdata);
+		if(clen < 4 || clen > qend - qbuf)
+			break;
+		qbuf += clen;
+		if(clen < 8)
+			continue;
+		int flag = *(int*)pdata;
+		if(!(flag & QUERY_POSITION))
+			continue;
+		int position = ((*(int*)(pdata + ((flag & QUERY_CODE) ? 8 : 4))) >> 24) & 0xff;
+		bool hidden;
+		if(location & (LOCATION_DECK | LOCATION_HAND | LOCATION_EXTRA))
+			hidden = !(position & POS_FACEUP);
+		else
+			hidden = (position & POS_FACEDOWN) != 0;
+		if(hidden)
+			memset(pdata, 0, clen - 4);
+	}
+	return len;
+}
+QueryCache::CardQuery& QueryCache::GetCard(int player, int location, size_t index) {
+	std::vector<CardQuery>& slots = cards[(player << 8) | location];
+	if(index >= slots.size())
+		slots.resize(index + 1);
+	return slots[index];
+}
+bool QueryCache::ParseQuery(unsigned int flag, char* data, int len, char** field, int* size) {
+	if(flag & ~QUERY_DELTA_MASK)
+		return false;
+	char* pend = data + len;
+	for(int b = 0; b < 32; ++b) {
+		unsigned int bit = 1U << b;
+		size[b] = 0;
+		if(!(flag & bit))
+			continue;
+		int fsize = 4;
+		if(bit == QUERY_LINK)
+			fsize = 8;
+		else if(bit == QUERY_TARGET_CARD || bit == QUERY_OVERLAY_CARD || bit == QUERY_COUNTERS) {
+			if(pend - data < 4)
+				return false;
+			char* pcount = data;
+			int count = BufferIO::ReadInt32(pcount);
+			if(count < 0 || count > (pend - data) / 4)
+				return false;
+			fsize += count * 4;
+		}
+		if(pend - data < fsize)
+			return false;
+		field[b] = data;
+		size[b] = fsize;
+		data += fsize;
+	}
+	return data == pend;
+}
+void QueryCache::MergeQuery(CardQuery& card, unsigned int flag, char** field, int* size) {
+	char* cached[32];
+	int csize[32];
+	ParseQuery(card.flag, card.data.data(), (int)card.data.size(), cached, csize);
+	std::vector<char> data;
+	for(int b = 0; b < 32; ++b) {
+		unsigned int bit = 1U << b;
+		if(flag & bit)
+			data.insert(data.end(), field[b], field[b] + size[b]);
+		else if(card.flag & bit)
+			data.insert(data.end(), cached[b], cached[b] + csize[b]);
+	}
+	card.flag |= flag;
+	card.data.swap(data);
+}
+
+}
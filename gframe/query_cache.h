@@ -0,0 +1,47 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include "config.h"
+#include "../ocgcore/common.h"
+#include <vector>
+#include <map>
+#include <set>
+
+// MSG_UPDATE_DATA carrying only the fields that changed since the last update
+#define MSG_UPDATE_DATA_DELTA	0xf0
+
+namespace ygo {
+
+// Last MSG_UPDATE_DATA state of every card slot seen by one receiver.
+// The server and the client keep one each and must see the same updates in the same order.
+class QueryCache {
+public:
+	void Clear();
+	int WriteUpdate(char* msg, int len, char* buf);
+	void StoreUpdate(char* msg, int len);
+	int ReadDelta(char* msg, int len, char* buf, int maxlen);
+	void Invalidate(int player, int location);
+	// invalidates a location the receiver failed to read, at most once per engine batch
+	bool Resync(int player, int location);
+	void EndBatch() { resynced.clear(); }
+
+	// copy of a MSG_UPDATE_DATA with the cards hidden from the opponent and observers blanked
+	static int PublicView(char* msg, int len, char* buf);
+
+private:
+	struct CardQuery {
+		unsigned int flag;
+		std::vector<char> data;
+		CardQuery(): flag(0) {}
+	};
+	CardQuery& GetCard(int player, int location, size_t index);
+	static bool ParseQuery(unsigned int flag, char* data, int len, char** field, int* size);
+	static void MergeQuery(CardQuery& card, unsigned int flag, char** field, int* size);
+
+	std::map<int, std::vector<CardQuery>> cards;
+	std::set<int> resynced;
+};
+
+}
+
+#endif //QUERY_CACHE_H
@@ -1,25 +1,165 @@
 #include "replay.h"
+#include "replay_writer.h"
 #include "../ocgcore/ocgapi.h"
 #include "../ocgcore/common.h"
 #include "lzma/LzmaLib.h"
 
 namespace ygo {
 
+int Replay::compression_level = REPLAY_LEVEL_DEFAULT;
+
+// LZ codec of REPLAY_LZ chunks: sequences of a token (literal length << 4 | match length - 4),
+// the literals, a 2 byte offset and the match, lengths of 15 or more continue in bytes added up until one is not 255.
+// The last sequence has only literals.
+#define LZ_MIN_MATCH	4
+#define LZ_HASH_BITS	12
+
+static unsigned char* LzWriteLength(unsigned char* op, size_t len) {
+	for(; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = (unsigned char)len;
+	return op;
+}
+static unsigned char* LzWriteSequence(unsigned char* op, const unsigned char* literals, size_t litlen, size_t offset, size_t matchlen) {
+	size_t mlen = matchlen ? matchlen - LZ_MIN_MATCH : 0;
+	*op++ = (unsigned char)((std::min(litlen, (size_t)15) << 4) | std::min(mlen, (size_t)15));
+	if(litlen >= 15)
+		op = LzWriteLength(op, litlen - 15);
+	memcpy(op, literals, litlen);
+	op += litlen;
+	if(!matchlen)
+		return op;
+	*op++ = (unsigned char)offset;
+	*op++ = (unsigned char)(offset >> 8);
+	if(mlen >= 15)
+		op = LzWriteLength(op, mlen - 15);
+	return op;
+}
+// greedy, one candidate per hash; returns 0 when the output would not fit in capacity
+static size_t LzCompress(const unsigned char* src, size_t size, unsigned char* dst, size_t capacity) {
+	// worst case is all literals
+	if(capacity < size + size / 255 + 16)
+		return 0;
+	unsigned int table[1 << LZ_HASH_BITS] = { 0 };
+	unsigned char* op = dst;
+	size_t anchor = 0;
+	size_t pos = 0;
+	while(pos + LZ_MIN_MATCH <= size) {
+		unsigned int seq;
+		memcpy(&seq, src + pos, 4);
+		unsigned int h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t ref = table[h];
+		table[h] = (unsigned int)pos + 1;
+		if(!ref || pos + 1 - ref > 0xffff || memcmp(src + ref - 1, src + pos, 4)) {
+			++pos;
+			continue;
+		}
+		--ref;
+		size_t len = LZ_MIN_MATCH;
+		while(pos + len < size && src[ref + len] == src[pos + len])
+			++len;
+		op = LzWriteSequence(op, src + anchor, pos - anchor, pos - ref, len);
+		pos += len;
+		anchor = pos;
+	}
+	op = LzWriteSequence(op, src + anchor, size - anchor, 0, 0);
+	return op - dst;
+}
+static bool LzReadLength(const unsigned char*& ip, const unsigned char* end, size_t& len) {
+	unsigned char b;
+	do {
+		if(ip >= end)
+			return false;
+		b = *ip++;
+		len += b;
+	} while(b == 255);
+	return true;
+}
+// returns the decoded size, 0 on malformed input
+static size_t LzUncompress(const unsigned char* src, size_t size, unsigned char* dst, size_t capacity) {
+	const unsigned char* ip = src;
+	const unsigned char* end = src + size;
+	unsigned char* op = dst;
+	unsigned char* op_end = dst + capacity;
+	while(ip < end) {
+		unsigned char token = *ip++;
+		size_t litlen = token >> 4;
+		if(litlen == 15 && !LzReadLength(ip, end, litlen))
+			return 0;
+		if(litlen > (size_t)(end - ip) || litlen > (size_t)(op_end - op))
+			return 0;
+		memcpy(op, ip, litlen);
+		ip += litlen;
+		op += litlen;
+		if(ip == end)
+			break;
+		if(end - ip < 2)
+			return 0;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		size_t matchlen = token & 0xf;
+		if(matchlen == 15 && !LzReadLength(ip, end, matchlen))
+			return 0;
+		matchlen += LZ_MIN_MATCH;
+		if(!offset || offset > (size_t)(op - dst) || matchlen > (size_t)(op_end - op))
+			return 0;
+		// the match may overlap its own output
+		const unsigned char* match = op - offset;
+		for(size_t i = 0; i < matchlen; ++i)
+			op[i] = match[i];
+		op += matchlen;
+	}
+	return op - dst;
+}
+
 Replay::Replay()
-	: fp(nullptr), pheader(), pdata(nullptr), replay_size(0), comp_size(0), is_recording(false), is_replaying(false) {
+	: fp(nullptr), pheader(), replay_size(0), journal(nullptr), level(REPLAY_LEVEL_DEFAULT), map_data(nullptr), map_size(0), map_pos(0), chunk_data(nullptr), chunk_size(0),
+	data_pos(0), journal_pos(0), read_size(0), is_recording(false), is_replaying(false) {
 	#ifdef _WIN32
 		recording_fp = nullptr;
 	#endif
-	replay_data = new unsigned char[MAX_REPLAY_SIZE];
-	comp_data = new unsigned char[MAX_COMP_SIZE];
+	archive_name[0] = 0;
+	replay_name[0] = 0;
 }
 Replay::~Replay() {
-	delete[] replay_data;
-	delete[] comp_data;
+	if(journal)
+		ReplayWriter::CloseJournal(journal);
+	UnmapReplay();
+}
+void Replay::ResetData() {
+	comp_data.clear();
+	chunks.clear();
+	replay_data.clear();
+	replay_data.reserve(REPLAY_CHUNK_SIZE);
+	replay_size = 0;
+	chunk_data = nullptr;
+	chunk_size = 0;
+	data_pos = 0;
+	journal_pos = 0;
+	read_size = 0;
+}
+void Replay::BeginJournal(const char* name) {
+	// the journal is written by the replay writer thread
+	if(journal)
+		ReplayWriter::CloseJournal(journal);
+	if(name) {
+		char file[256];
+		snprintf(file, sizeof(file), "%s.yrpj", name);
+		journal = ReplayWriter::OpenJournal(file, compression_level);
+		strncpy(archive_name, name, sizeof(archive_name) - 1);
+		archive_name[sizeof(archive_name) - 1] = 0;
+	} else {
+		journal = ReplayWriter::OpenJournal("./replay/_LastReplay.yrp", compression_level);
+		archive_name[0] = 0;
+	}
+	ResetData();
+	is_replaying = false;
+	is_recording = true;
 }
 void Replay::BeginRecord() {
 	if(!FileSystem::IsDirExists(L"./replay") && !FileSystem::MakeDir(L"./replay"))
 		return;
+	UnmapReplay();
 #ifdef _WIN32
 	if(is_recording)
 		CloseHandle(recording_fp);
@@ -33,14 +173,17 @@ void Replay::BeginRecord() {
 	if(!fp)
 		return;
 #endif
-	pdata = replay_data;
-	replay_size = 0;
-	comp_size = 0;
+	ResetData();
+	level = compression_level;
 	is_replaying = false;
 	is_recording = true;
 }
 void Replay::WriteHeader(ReplayHeader& header) {
 	pheader = header;
+	if(journal) {
+		ReplayWriter::WriteJournal(journal, &header, sizeof(header));
+		return;
+	}
 #ifdef _WIN32
 	DWORD size;
 	WriteFile(recording_fp, &header, sizeof(header), &size, NULL);
@@ -50,65 +193,42 @@ void Replay::WriteHeader(ReplayHeader& header) {
 #endif
 }
 void Replay::WriteData(const void* data, int length, bool flush) {
-	if(!is_recording)
-		return;
-	if (length < 0 || (pdata - replay_data) + length > MAX_REPLAY_SIZE)
+	if(length < 0)
 		return;
-	memcpy(pdata, data, length);
-	pdata += length;
-#ifdef _WIN32
-	DWORD size;
-	WriteFile(recording_fp, data, length, &size, NULL);
-#else
-	fwrite(data, length, 1, fp);
-	if(flush)
-		fflush(fp);
-#endif
+	WriteRaw(data, length, flush);
 }
 void Replay::WriteInt32(int data, bool flush) {
-	if(!is_recording)
-		return;
-	if ((pdata - replay_data) + 4 > MAX_REPLAY_SIZE)
-		return;
-	*((int*)(pdata)) = data;
-	pdata += 4;
-#ifdef _WIN32
-	DWORD size;
-	WriteFile(recording_fp, &data, sizeof(int), &size, NULL);
-#else
-	fwrite(&data, sizeof(int), 1, fp);
-	if(flush)
-		fflush(fp);
-#endif
+	WriteRaw(&data, sizeof(int), flush);
 }
 void Replay::WriteInt16(short data, bool flush) {
-	if(!is_recording)
-		return;
-	if ((pdata - replay_data) + 2 > MAX_REPLAY_SIZE)
-		return;
-	*((short*)(pdata)) = data;
-	pdata += 2;
-#ifdef _WIN32
-	DWORD size;
-	WriteFile(recording_fp, &data, sizeof(short), &size, NULL);
-#else
-	fwrite(&data, sizeof(short), 1, fp);
-	if(flush)
-		fflush(fp);
-#endif
+	WriteRaw(&data, sizeof(short), flush);
 }
 void Replay::WriteInt8(char data, bool flush) {
+	WriteRaw(&data, sizeof(char), flush);
+}
+void Replay::WriteRaw(const void* data, size_t length, bool flush) {
 	if(!is_recording)
 		return;
-	if ((pdata - replay_data) + 1 > MAX_REPLAY_SIZE)
+	const unsigned char* p = (const unsigned char*)data;
+	for(size_t left = length; left;) {
+		size_t len = std::min(left, REPLAY_CHUNK_SIZE - replay_data.size());
+		replay_data.insert(replay_data.end(), p, p + len);
+		p += len;
+		left -= len;
+		if(replay_data.size() == REPLAY_CHUNK_SIZE)
+			SealChunk();
+	}
+	replay_size += length;
+	if(journal) {
+		if(flush)
+			WriteJournal();
 		return;
-	*pdata = data;
-	pdata++;
+	}
 #ifdef _WIN32
 	DWORD size;
-	WriteFile(recording_fp, &data, sizeof(char), &size, NULL);
+	WriteFile(recording_fp, data, length, &size, NULL);
 #else
-	fwrite(&data, sizeof(char), 1, fp);
+	fwrite(data, length, 1, fp);
 	if(flush)
 		fflush(fp);
 #endif
@@ -116,34 +236,84 @@ void Replay::WriteInt8(char data, bool flush) {
 void Replay::Flush() {
 	if(!is_recording)
 		return;
+	if(journal) {
+		WriteJournal();
+		return;
+	}
 #ifdef _WIN32
 #else
 	fflush(fp);
 #endif
 }
+void Replay::WriteJournal() {
+	ReplayWriter::WriteJournal(journal, replay_data.data() + journal_pos, replay_data.size() - journal_pos);
+	journal_pos = replay_data.size();
+}
+void Replay::SealChunk() {
+	if(replay_data.empty())
+		return;
+	// journaled replays are compressed by the writer thread
+	if(journal) {
+		WriteJournal();
+		ReplayWriter::WriteChunk(journal, replay_data.data(), replay_data.size());
+	} else
+		CompressChunk(replay_data.data(), replay_data.size(), comp_data, chunks, pheader.props, level);
+	replay_data.clear();
+	journal_pos = 0;
+}
 void Replay::EndRecord() {
 	if(!is_recording)
 		return;
+	SealChunk();
+	pheader.datasize = replay_size;
+	// a journal is finished by ReplayWriter::Finish
+	if(!journal) {
 #ifdef _WIN32
-	CloseHandle(recording_fp);
+		CloseHandle(recording_fp);
 #else
-	fclose(fp);
+		fclose(fp);
+		fp = nullptr;
 #endif
-	if(pdata - replay_data > 0 && pdata - replay_data <= MAX_REPLAY_SIZE)
-		replay_size = pdata - replay_data;
-	else
-		replay_size = 0;
-	pheader.datasize = replay_size;
-	pheader.flag |= REPLAY_COMPRESSED;
-	size_t propsize = 5;
-	comp_size = MAX_COMP_SIZE;
-	int ret = LzmaCompress(comp_data, &comp_size, replay_data, replay_size, pheader.props, &propsize, 5, 1 << 24, 3, 0, 2, 32, 1);
-	if (ret != SZ_OK) {
-		*((int*)(comp_data)) = ret;
-		comp_size = sizeof(ret);
+		EndChunks(pheader, comp_data, chunks, level);
 	}
 	is_recording = false;
 }
+void Replay::CompressChunk(const unsigned char* data, size_t size, std::vector<unsigned char>& comp, std::vector<ReplayChunk>& chunks, unsigned char* props, int level) {
+	ReplayChunk chunk;
+	chunk.offset = (unsigned int)comp.size();
+	chunk.datasize = (unsigned int)size;
+	size_t pos = comp.size() + 8;
+	comp.resize(pos + size + size / 2 + 256);
+	size_t comp_size = comp.size() - pos;
+	int ret = SZ_OK;
+	if(level == REPLAY_LEVEL_FAST) {
+		comp_size = LzCompress(data, size, &comp[pos], comp_size);
+	} else {
+		size_t propsize = 5;
+		level = std::min(std::max(level, 1), 9);
+		ret = LzmaCompress(&comp[pos], &comp_size, data, size, props, &propsize, level, REPLAY_CHUNK_SIZE, 3, 0, 2, level < 7 ? 32 : 273, 1);
+	}
+	if(ret != SZ_OK || !comp_size || comp_size >= size) {
+		memcpy(&comp[pos], data, size);
+		comp_size = size;
+	}
+	chunk.size = (unsigned int)comp_size;
+	memcpy(&comp[chunk.offset], &chunk.size, 4);
+	memcpy(&comp[chunk.offset + 4], &chunk.datasize, 4);
+	comp.resize(pos + comp_size);
+	chunks.push_back(chunk);
+}
+void Replay::EndChunks(ReplayHeader& header, std::vector<unsigned char>& comp, const std::vector<ReplayChunk>& chunks, int level) {
+	header.flag = (header.flag & ~(REPLAY_COMPRESSED | REPLAY_LZ)) | REPLAY_CHUNKED;
+	if(level == REPLAY_LEVEL_FAST)
+		header.flag |= REPLAY_LZ;
+	unsigned int footer[2] = { (unsigned int)chunks.size(), REPLAY_TABLE_ID };
+	size_t pos = comp.size();
+	comp.resize(pos + chunks.size() * sizeof(ReplayChunk) + sizeof(footer));
+	if(chunks.size())
+		memcpy(&comp[pos], chunks.data(), chunks.size() * sizeof(ReplayChunk));
+	memcpy(&comp[comp.size() - sizeof(footer)], footer, sizeof(footer));
+}
 void Replay::SaveReplay(const wchar_t* name) {
 	if(!FileSystem::IsDirExists(L"./replay") && !FileSystem::MakeDir(L"./replay"))
 		return;
@@ -159,60 +329,66 @@ void Replay::SaveReplay(const wchar_t* name) {
 	if(!fp)
 		return;
 	fwrite(&pheader, sizeof(pheader), 1, fp);
-	fwrite(comp_data, comp_size, 1, fp);
+	fwrite(comp_data.data(), comp_data.size(), 1, fp);
 	fclose(fp);
+	fp = nullptr;
 }
 bool Replay::OpenReplay(const wchar_t* name) {
-#ifdef WIN32
-	fp = _wfopen(name, L"rb");
-#else
-	char name2[256];
-	BufferIO::EncodeUTF8(name, name2);
-	fp = fopen(name2, "rb");
-#endif
-	if(!fp) {
+	UnmapReplay();
+	is_recording = false;
+	is_replaying = false;
+	BufferIO::CopyWStr(name, replay_name, 256);
+	map_data = FileSystem::MapFile(name, &map_size);
+	if(!map_data) {
 		wchar_t fname[256];
 		myswprintf(fname, L"./replay/%ls", name);
-#ifdef WIN32
-		fp = _wfopen(fname, L"rb");
-#else
-		char fname2[256];
-		BufferIO::EncodeUTF8(fname, fname2);
-		fp = fopen(fname2, "rb");
-#endif
+		BufferIO::CopyWStr(fname, replay_name, 256);
+		map_data = FileSystem::MapFile(fname, &map_size);
 	}
-	if(!fp)
+	if(!map_data)
 		return false;
 
-	pdata = replay_data;
-	is_recording = false;
-	is_replaying = false;
-	replay_size = 0;
-	comp_size = 0;
-	if(fread(&pheader, sizeof(pheader), 1, fp) < 1) {
-		fclose(fp);
+	ResetData();
+	checkpoints.clear();
+	response_batches.clear();
+	if(map_size < sizeof(pheader)) {
+		UnmapReplay();
 		return false;
 	}
-	if(pheader.flag & REPLAY_COMPRESSED) {
-		comp_size = fread(comp_data, 1, MAX_COMP_SIZE, fp);
-		fclose(fp);
-		if ((int)pheader.datasize < 0 && (int)pheader.datasize > MAX_REPLAY_SIZE)
-			return false;
+	memcpy(&pheader, map_data, sizeof(pheader));
+	map_pos = sizeof(pheader);
+	// chunked and uncompressed replays are read from the mapped file as they are played
+	if(pheader.flag & REPLAY_CHUNKED) {
 		replay_size = pheader.datasize;
-		if (LzmaUncompress(replay_data, &replay_size, comp_data, &comp_size, pheader.props, 5) != SZ_OK)
+	} else if(pheader.flag & REPLAY_COMPRESSED) {
+		if(pheader.datasize > MAX_REPLAY_SIZE) {
+			UnmapReplay();
 			return false;
-		if (replay_size != pheader.datasize) {
+		}
+		replay_data.resize(pheader.datasize);
+		replay_size = pheader.datasize;
+		size_t comp_size = map_size - map_pos;
+		int ret = LzmaUncompress(replay_data.data(), &replay_size, map_data + map_pos, &comp_size, pheader.props, 5);
+		UnmapReplay();
+		if(ret != SZ_OK || replay_size != pheader.datasize) {
+			replay_data.clear();
 			replay_size = 0;
 			return false;
 		}
-	} else {
-		replay_size = fread(replay_data, 1, MAX_REPLAY_SIZE, fp);
-		fclose(fp);
-		comp_size = 0;
+		chunk_data = replay_data.data();
+		chunk_size = replay_size;
 	}
 	is_replaying = true;
 	return true;
 }
+void Replay::UnmapReplay() {
+	if(!map_data)
+		return;
+	FileSystem::UnmapFile(map_data, map_size);
+	map_data = nullptr;
+	map_size = 0;
+	map_pos = 0;
+}
 bool Replay::CheckReplay(const wchar_t* name) {
 	wchar_t fname[256];
 	myswprintf(fname, L"./replay/%ls", name);
@@ -228,7 +404,10 @@ bool Replay::CheckReplay(const wchar_t* name) {
 	ReplayHeader rheader;
 	size_t count = fread(&rheader, sizeof(ReplayHeader), 1, rfp);
 	fclose(rfp);
-	return count == 1 && rheader.id == 0x31707279 && rheader.version >= 0x12d0u && (rheader.version < 0x1353u || (rheader.flag & REPLAY_UNIFORM));
+	return count == 1 && CheckHeader(rheader);
+}
+bool Replay::CheckHeader(const ReplayHeader& header) {
+	return header.id == 0x31707279 && header.version >= 0x12d0u && (header.version < 0x1353u || (header.flag & REPLAY_UNIFORM));
 }
 bool Replay::DeleteReplay(const wchar_t* name) {
 	wchar_t fname[256];
@@ -261,49 +440,156 @@ bool Replay::RenameReplay(const wchar_t* oldname, const wchar_t* newname) {
 #endif
 }
 bool Replay::ReadNextResponse(unsigned char resp[64]) {
-	if(pdata - replay_data >= (int)replay_size)
+	unsigned char len;
+	if(!ReadData(&len, 1) || len > 64)
 		return false;
-	int len = *pdata++;
-	if(len > 64)
-		return false;
-	memcpy(resp, pdata, len);
-	pdata += len;
-	return true;
+	return ReadData(resp, len);
 }
 void Replay::ReadName(wchar_t* data) {
 	if(!is_replaying)
 		return;
 	unsigned short buffer[20];
-	ReadData(buffer, 40);
+	if(!ReadData(buffer, 40))
+		buffer[0] = 0;
 	BufferIO::CopyWStr(buffer, data, 20);
 }
-void Replay::ReadData(void* data, int length) {
-	if(!is_replaying)
-		return;
-	memcpy(data, pdata, length);
-	pdata += length;
+bool Replay::ReadData(void* data, int length) {
+	if(!is_replaying || length < 0)
+		return false;
+	unsigned char* p = (unsigned char*)data;
+	while(length > 0) {
+		if(data_pos == chunk_size && !ReadChunk())
+			return false;
+		size_t len = std::min((size_t)length, chunk_size - data_pos);
+		memcpy(p, chunk_data + data_pos, len);
+		data_pos += len;
+		p += len;
+		length -= (int)len;
+	}
+	return true;
 }
 int Replay::ReadInt32() {
-	if(!is_replaying)
+	int ret;
+	if(!ReadData(&ret, sizeof(int)))
 		return -1;
-	int ret = *((int*)pdata);
-	pdata += 4;
 	return ret;
 }
 short Replay::ReadInt16() {
-	if(!is_replaying)
+	short ret;
+	if(!ReadData(&ret, sizeof(short)))
 		return -1;
-	short ret = *((short*)pdata);
-	pdata += 2;
 	return ret;
 }
 char Replay::ReadInt8() {
-	if(!is_replaying)
+	char ret;
+	if(!ReadData(&ret, sizeof(char)))
 		return -1;
-	return *pdata++;
+	return ret;
+}
+bool Replay::ReadChunk() {
+	// the single block format is decompressed by OpenReplay
+	if(!map_data || map_pos >= map_size)
+		return false;
+	data_pos = 0;
+	chunk_size = 0;
+	if(!(pheader.flag & REPLAY_CHUNKED)) {
+		chunk_data = map_data + map_pos;
+		chunk_size = map_size - map_pos;
+		map_pos = map_size;
+		return true;
+	}
+	if(read_size >= pheader.datasize)
+		return false;
+	unsigned int info[2];
+	if(map_size - map_pos < sizeof(info))
+		return false;
+	memcpy(info, map_data + map_pos, sizeof(info));
+	if(!info[1] || info[1] > REPLAY_CHUNK_SIZE || info[0] > info[1] * 2 + 256 || info[0] > map_size - map_pos - sizeof(info))
+		return false;
+	const unsigned char* comp = map_data + map_pos + sizeof(info);
+	// stored chunks are read in place, the others are decompressed straight from the map
+	if(info[0] == info[1]) {
+		chunk_data = comp;
+	} else {
+		replay_data.resize(info[1]);
+		size_t comp_size = info[0];
+		size_t size = info[1];
+		if(pheader.flag & REPLAY_LZ)
+			size = LzUncompress(comp, comp_size, replay_data.data(), size);
+		else if(LzmaUncompress(replay_data.data(), &size, comp, &comp_size, pheader.props, 5) != SZ_OK)
+			size = 0;
+		if(size != info[1])
+			return false;
+		chunk_data = replay_data.data();
+	}
+	chunk_size = info[1];
+	map_pos += sizeof(info) + info[0];
+	read_size += info[1];
+	return true;
 }
 void Replay::Rewind() {
-	pdata = replay_data;
+	data_pos = 0;
+	if(map_data) {
+		map_pos = sizeof(ReplayHeader);
+		chunk_size = 0;
+		read_size = 0;
+	}
+}
+FILE* Replay::OpenIndex(const wchar_t* mode) {
+	wchar_t fname[256];
+	myswprintf(fname, L"%lsi", replay_name);
+#ifdef WIN32
+	return _wfopen(fname, mode);
+#else
+	char fname2[256], mode2[8];
+	BufferIO::EncodeUTF8(fname, fname2);
+	BufferIO::EncodeUTF8(mode, mode2);
+	return fopen(fname2, mode2);
+#endif
+}
+bool Replay::LoadIndex() {
+	checkpoints.clear();
+	checkpoint_hints.clear();
+	response_batches.clear();
+	FILE* ifp = OpenIndex(L"rb");
+	if(!ifp)
+		return false;
+	unsigned int info[8];
+	bool ok = fread(info, sizeof(info), 1, ifp) == 1 && info[0] == REPLAY_INDEX_ID && info[1] == REPLAY_INDEX_VERSION && info[2] == pheader.seed
+		&& info[3] == pheader.start_time && info[4] == pheader.datasize && info[5] && info[5] < 0x100000 && info[6] < 0x1000000 && info[7] < 0x100000;
+	if(ok) {
+		checkpoints.resize(info[5]);
+		response_batches.resize(info[6]);
+		checkpoint_hints.resize(info[7]);
+		ok = fread(checkpoints.data(), sizeof(ReplayCheckpoint), info[5], ifp) == info[5]
+			&& fread(response_batches.data(), sizeof(unsigned int), info[6], ifp) == info[6]
+			&& fread(checkpoint_hints.data(), sizeof(ReplayHint), info[7], ifp) == info[7];
+	}
+	fclose(ifp);
+	for(auto cit = checkpoints.begin(); ok && cit != checkpoints.end(); ++cit)
+		ok = cit->hint_start <= info[7] && cit->hint_count <= info[7] - cit->hint_start;
+	if(!ok) {
+		checkpoints.clear();
+		checkpoint_hints.clear();
+		response_batches.clear();
+	}
+	return ok;
+}
+void Replay::SaveIndex() {
+	if(checkpoints.empty())
+		return;
+	FILE* ifp = OpenIndex(L"wb");
+	if(!ifp)
+		return;
+	unsigned int info[8] = { REPLAY_INDEX_ID, REPLAY_INDEX_VERSION, pheader.seed, pheader.start_time, pheader.datasize,
+		(unsigned int)checkpoints.size(), (unsigned int)response_batches.size(), (unsigned int)checkpoint_hints.size() };
+	fwrite(info, sizeof(info), 1, ifp);
+	fwrite(checkpoints.data(), sizeof(ReplayCheckpoint), checkpoints.size(), ifp);
+	if(response_batches.size())
+		fwrite(response_batches.data(), sizeof(unsigned int), response_batches.size(), ifp);
+	if(checkpoint_hints.size())
+		fwrite(checkpoint_hints.data(), sizeof(ReplayHint), checkpoint_hints.size(), ifp);
+	fclose(ifp);
 }
 
 }
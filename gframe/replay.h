@@ -3,20 +3,34 @@
 
 #include "config.h"
 #include <time.h>
+#include <vector>
 
 namespace ygo {
 
+struct ReplayJournal;
+
 // replay flag
 #define REPLAY_COMPRESSED	0x1
 #define REPLAY_TAG			0x2
 #define REPLAY_DECODED		0x4
 #define REPLAY_SINGLE_MODE	0x8
 #define REPLAY_UNIFORM		0x10
+#define REPLAY_CHUNKED		0x20
+#define REPLAY_LZ			0x40
 
-// max size
+// max size of the single block format
 #define MAX_REPLAY_SIZE	0x20000
 #define MAX_COMP_SIZE	0x2000
 
+// raw bytes per chunk of the chunked format
+#define REPLAY_CHUNK_SIZE	0x8000
+#define REPLAY_TABLE_ID		0x74637279
+#define REPLAY_INDEX_ID		0x69707279
+#define REPLAY_INDEX_VERSION	2
+// compression level of the chunks, 1-9 for LZMA, REPLAY_LEVEL_FAST for the LZ codec (REPLAY_LZ)
+#define REPLAY_LEVEL_FAST	0
+#define REPLAY_LEVEL_DEFAULT	5
+
 struct ReplayHeader {
 	unsigned int id;
 	unsigned int version;
@@ -30,6 +44,37 @@ struct ReplayHeader {
 		: id(0), version(0), flag(0), seed(0), datasize(0), start_time(0), props{ 0 } {}
 };
 
+// A chunked replay (REPLAY_CHUNKED) is the header, with the total raw size in datasize and the LZMA props
+// shared by all chunks (unused with REPLAY_LZ), then the chunks, each one unsigned int size, unsigned int datasize and size bytes
+// (stored as is when size == datasize), then ReplayChunk[count], unsigned int count, REPLAY_TABLE_ID.
+struct ReplayChunk {
+	unsigned int offset;
+	unsigned int size;
+	unsigned int datasize;
+};
+
+// seek index entry, the state of a replay after the engine message batch that started a turn or phase
+struct ReplayCheckpoint {
+	unsigned int batch;
+	unsigned int step;
+	unsigned int responses;
+	unsigned short turn;
+	unsigned short phase;
+	unsigned char tag_player[2];
+	unsigned char reserved[2];
+	// MSG_FIELD_DISABLED mask and Replay::checkpoint_hints[hint_start, hint_start + hint_count) at the checkpoint
+	unsigned int field_disabled;
+	unsigned int hint_start;
+	unsigned int hint_count;
+};
+
+// a player hint added by PHINT_DESC_ADD and not removed yet
+struct ReplayHint {
+	unsigned int desc;
+	unsigned char player;
+	unsigned char reserved[3];
+};
+
 class Replay {
 public:
 	Replay();
@@ -37,6 +82,7 @@ public:
 
 	// record
 	void BeginRecord();
+	void BeginJournal(const char* name);
 	void WriteHeader(ReplayHeader& header);
 	void WriteData(const void* data, int length, bool flush = true);
 	void WriteInt32(int data, bool flush = true);
@@ -45,20 +91,25 @@ public:
 	void Flush();
 	void EndRecord();
 	void SaveReplay(const wchar_t* name);
+	static void CompressChunk(const unsigned char* data, size_t size, std::vector<unsigned char>& comp, std::vector<ReplayChunk>& chunks, unsigned char* props, int level);
+	static void EndChunks(ReplayHeader& header, std::vector<unsigned char>& comp, const std::vector<ReplayChunk>& chunks, int level);
 
 	// play
 	bool OpenReplay(const wchar_t* name);
 	static bool CheckReplay(const wchar_t* name);
+	static bool CheckHeader(const ReplayHeader& header);
 	static bool DeleteReplay(const wchar_t* name);
 	static bool RenameReplay(const wchar_t* oldname, const wchar_t* newname);
 	bool ReadNextResponse(unsigned char resp[64]);
 	void ReadName(wchar_t* data);
 	void ReadHeader(ReplayHeader& header);
-	void ReadData(void* data, int length);
+	bool ReadData(void* data, int length);
 	int ReadInt32();
 	short ReadInt16();
 	char ReadInt8();
 	void Rewind();
+	bool LoadIndex();
+	void SaveIndex();
 
 	FILE* fp;
 #ifdef _WIN32
@@ -66,13 +117,44 @@ public:
 #endif
 
 	ReplayHeader pheader;
-	unsigned char* replay_data;
-	unsigned char* comp_data;
+	// the file after the header
+	std::vector<unsigned char> comp_data;
 	size_t replay_size;
-	size_t comp_size;
+	// the finished replay is archived as name.yrp when set
+	char archive_name[256];
+	// the file being played
+	wchar_t replay_name[256];
+	// seek index, cached as name.yrpi next to the replay
+	std::vector<ReplayCheckpoint> checkpoints;
+	std::vector<ReplayHint> checkpoint_hints;
+	std::vector<unsigned int> response_batches;
+	// level of the replays recorded from now on
+	static int compression_level;
 
 private:
-	unsigned char* pdata;
+	friend class ReplayWriter;
+	void ResetData();
+	void UnmapReplay();
+	FILE* OpenIndex(const wchar_t* mode);
+	void WriteRaw(const void* data, size_t length, bool flush);
+	void WriteJournal();
+	void SealChunk();
+	bool ReadChunk();
+
+	ReplayJournal* journal;
+	int level;
+	std::vector<ReplayChunk> chunks;
+	// the chunk being recorded, or the decompressed chunk being played
+	std::vector<unsigned char> replay_data;
+	// the replay being played is mapped, chunk_data points into the map or at replay_data
+	const unsigned char* map_data;
+	size_t map_size;
+	size_t map_pos;
+	const unsigned char* chunk_data;
+	size_t chunk_size;
+	size_t data_pos;
+	size_t journal_pos;
+	size_t read_size;
 	bool is_recording;
 	bool is_replaying;
 };
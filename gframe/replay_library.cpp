@@ -0,0 +1,255 @@
+#include "replay_library.h"
+#include "game.h"
+#include <unordered_map>
+
+namespace ygo {
+
+std::vector<ReplayEntry> ReplayLibrary::entries;
+std::vector<int> ReplayLibrary::filtered;
+std::wstring ReplayLibrary::filter;
+bool ReplayLibrary::loaded = false;
+
+static const char* REPLAY_LIBRARY_FILE = "./replay/library.dat";
+
+void ReplayLibrary::Refresh() {
+	if(!loaded) {
+		Load();
+		loaded = true;
+	}
+	std::unordered_map<std::wstring, size_t> known;
+	for(size_t i = 0; i < entries.size(); ++i)
+		known[entries[i].name] = i;
+	std::vector<ReplayEntry> current;
+	bool changed = false;
+	FileSystem::TraversalDir(L"./replay", [&](const wchar_t* name, bool isdir) {
+		if(isdir || !wcsrchr(name, '.') || mywcsncasecmp(wcsrchr(name, '.'), L".yrp", 5))
+			return;
+		wchar_t fname[256];
+		myswprintf(fname, L"./replay/%ls", name);
+		unsigned long long size, mtime;
+		if(!FileSystem::GetFileInfo(fname, &size, &mtime))
+			return;
+		auto it = known.find(name);
+		if(it != known.end() && entries[it->second].size == size && entries[it->second].mtime == mtime) {
+			current.push_back(std::move(entries[it->second]));
+			return;
+		}
+		ReplayEntry entry;
+		entry.name = name;
+		entry.size = size;
+		entry.mtime = mtime;
+		ScanReplay(entry);
+		current.push_back(std::move(entry));
+		changed = true;
+	});
+	if(current.size() != entries.size())
+		changed = true;
+	entries.swap(current);
+	if(changed)
+		Save();
+	Filter(filter.c_str());
+}
+void ReplayLibrary::Filter(const wchar_t* text) {
+	filter = text;
+	filtered.clear();
+	for(size_t i = 0; i < entries.size(); ++i) {
+		const ReplayEntry& entry = entries[i];
+		if(!entry.valid)
+			continue;
+		bool match = mainGame->deckBuilder.CardNameContains(entry.name.c_str(), text);
+		for(int p = 0; p < 4 && !match; ++p)
+			match = entry.players[p][0] && mainGame->deckBuilder.CardNameContains(entry.players[p], text);
+		if(match)
+			filtered.push_back((int)i);
+	}
+}
+int ReplayLibrary::GetCount() {
+	return (int)filtered.size();
+}
+ReplayEntry* ReplayLibrary::GetEntry(int index) {
+	if(index < 0 || index >= (int)filtered.size())
+		return 0;
+	return &entries[filtered[index]];
+}
+ReplayEntry* ReplayLibrary::FindEntry(const wchar_t* name) {
+	for(auto& entry : entries)
+		if(entry.name == name)
+			return &entry;
+	return 0;
+}
+void ReplayLibrary::RenameEntry(const wchar_t* oldname, const wchar_t* newname) {
+	ReplayEntry* entry = FindEntry(oldname);
+	if(!entry)
+		return;
+	entry->name = newname;
+	Save();
+}
+void ReplayLibrary::RemoveEntry(const wchar_t* name) {
+	ReplayEntry* entry = FindEntry(name);
+	if(!entry)
+		return;
+	entries.erase(entries.begin() + (entry - entries.data()));
+	Save();
+	Filter(filter.c_str());
+}
+void ReplayLibrary::SetResult(const wchar_t* file, int winner, int turns) {
+	// only replays opened from ./replay are in the library
+	if(wcsncmp(file, L"./replay/", 9))
+		return;
+	ReplayEntry* entry = FindEntry(file + 9);
+	if(!entry || (entry->winner == winner && entry->turns == turns))
+		return;
+	entry->winner = winner;
+	entry->turns = turns;
+	Save();
+}
+void ReplayLibrary::ScanReplay(ReplayEntry& entry) {
+	entry.valid = false;
+	entry.winner = -1;
+	entry.turns = 0;
+	for(int p = 0; p < 4; ++p) {
+		entry.players[p][0] = 0;
+		entry.main[p].clear();
+		entry.extra[p].clear();
+	}
+	wchar_t fname[256];
+	myswprintf(fname, L"./replay/%ls", entry.name.c_str());
+	Replay replay;
+	if(!replay.OpenReplay(fname))
+		return;
+	entry.header = replay.pheader;
+	if(!Replay::CheckHeader(replay.pheader))
+		return;
+	entry.valid = true;
+	int players = (replay.pheader.flag & REPLAY_TAG) ? 4 : 2;
+	for(int p = 0; p < players; ++p)
+		replay.ReadName(entry.players[p]);
+	if(replay.pheader.flag & REPLAY_SINGLE_MODE)
+		return;
+	for(int i = 0; i < 4; ++i)
+		replay.ReadInt32();
+	for(int p = 0; p < players; ++p) {
+		int main = replay.ReadInt32();
+		if(main < 0 || main > 200)
+			return;
+		for(int i = 0; i < main; ++i)
+			entry.main[p].push_back(replay.ReadInt32());
+		int extra = replay.ReadInt32();
+		if(extra < 0 || extra > 200)
+			return;
+		for(int i = 0; i < extra; ++i)
+			entry.extra[p].push_back(replay.ReadInt32());
+	}
+}
+bool ReplayLibrary::Load() {
+	entries.clear();
+	FILE* fp = fopen(REPLAY_LIBRARY_FILE, "rb");
+	if(!fp)
+		return false;
+	std::vector<char> data;
+	char buf[0x1000];
+	size_t len;
+	while((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+		data.insert(data.end(), buf, buf + len);
+	fclose(fp);
+	char* pbuf = data.data();
+	char* end = pbuf + data.size();
+	if(data.size() < 12 || (unsigned int)BufferIO::ReadInt32(pbuf) != REPLAY_LIBRARY_ID || BufferIO::ReadInt32(pbuf) != REPLAY_LIBRARY_VERSION)
+		return false;
+	int count = BufferIO::ReadInt32(pbuf);
+	for(int i = 0; i < count; ++i) {
+		ReplayEntry entry;
+		if(end - pbuf < 2)
+			break;
+		int namelen = (unsigned short)BufferIO::ReadInt16(pbuf);
+		if(namelen >= 256 || end - pbuf < namelen * 2 + 16 + (int)sizeof(ReplayHeader) + 9 + 160)
+			break;
+		unsigned short name[256];
+		memcpy(name, pbuf, namelen * 2);
+		name[namelen] = 0;
+		pbuf += namelen * 2;
+		wchar_t wname[256];
+		BufferIO::CopyWStr(name, wname, 256);
+		entry.name = wname;
+		entry.size = (unsigned int)BufferIO::ReadInt32(pbuf);
+		entry.size |= (unsigned long long)(unsigned int)BufferIO::ReadInt32(pbuf) << 32;
+		entry.mtime = (unsigned int)BufferIO::ReadInt32(pbuf);
+		entry.mtime |= (unsigned long long)(unsigned int)BufferIO::ReadInt32(pbuf) << 32;
+		memcpy(&entry.header, pbuf, sizeof(ReplayHeader));
+		pbuf += sizeof(ReplayHeader);
+		entry.valid = BufferIO::ReadInt8(pbuf) != 0;
+		entry.winner = BufferIO::ReadInt32(pbuf);
+		entry.turns = BufferIO::ReadInt32(pbuf);
+		for(int p = 0; p < 4; ++p) {
+			BufferIO::CopyWStr((unsigned short*)pbuf, entry.players[p], 20);
+			pbuf += 40;
+		}
+		bool ok = true;
+		for(int p = 0; p < 4 && ok; ++p) {
+			for(int d = 0; d < 2 && ok; ++d) {
+				std::vector<int>& deck = d ? entry.extra[p] : entry.main[p];
+				int cards = end - pbuf < 2 ? -1 : (unsigned short)BufferIO::ReadInt16(pbuf);
+				if(cards < 0 || end - pbuf < cards * 4) {
+					ok = false;
+					break;
+				}
+				for(int j = 0; j < cards; ++j)
+					deck.push_back(BufferIO::ReadInt32(pbuf));
+			}
+		}
+		if(!ok)
+			break;
+		entries.push_back(std::move(entry));
+	}
+	if((int)entries.size() != count) {
+		// a damaged library is rebuilt from the files
+		entries.clear();
+		return false;
+	}
+	return true;
+}
+void ReplayLibrary::Save() {
+	FILE* fp = fopen(REPLAY_LIBRARY_FILE, "wb");
+	if(!fp)
+		return;
+	char buf[0x2000];
+	char* pbuf = buf;
+	BufferIO::WriteInt32(pbuf, REPLAY_LIBRARY_ID);
+	BufferIO::WriteInt32(pbuf, REPLAY_LIBRARY_VERSION);
+	BufferIO::WriteInt32(pbuf, (int)entries.size());
+	fwrite(buf, pbuf - buf, 1, fp);
+	for(auto& entry : entries) {
+		// at most 200 cards per deck, so an entry always fits
+		pbuf = buf;
+		unsigned short name[256];
+		int namelen = BufferIO::CopyWStr(entry.name.c_str(), name, 256);
+		BufferIO::WriteInt16(pbuf, namelen);
+		memcpy(pbuf, name, namelen * 2);
+		pbuf += namelen * 2;
+		BufferIO::WriteInt32(pbuf, (int)entry.size);
+		BufferIO::WriteInt32(pbuf, (int)(entry.size >> 32));
+		BufferIO::WriteInt32(pbuf, (int)entry.mtime);
+		BufferIO::WriteInt32(pbuf, (int)(entry.mtime >> 32));
+		memcpy(pbuf, &entry.header, sizeof(ReplayHeader));
+		pbuf += sizeof(ReplayHeader);
+		BufferIO::WriteInt8(pbuf, entry.valid);
+		BufferIO::WriteInt32(pbuf, entry.winner);
+		BufferIO::WriteInt32(pbuf, entry.turns);
+		for(int p = 0; p < 4; ++p) {
+			BufferIO::CopyWStr(entry.players[p], (unsigned short*)pbuf, 20);
+			pbuf += 40;
+		}
+		for(int p = 0; p < 4; ++p) {
+			BufferIO::WriteInt16(pbuf, (short)entry.main[p].size());
+			for(int code : entry.main[p])
+				BufferIO::WriteInt32(pbuf, code);
+			BufferIO::WriteInt16(pbuf, (short)entry.extra[p].size());
+			for(int code : entry.extra[p])
+				BufferIO::WriteInt32(pbuf, code);
+		}
+		fwrite(buf, pbuf - buf, 1, fp);
+	}
+	fclose(fp);
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef REPLAY_LIBRARY_H
+#define REPLAY_LIBRARY_H
+
+#include "config.h"
+#include "replay.h"
+#include <vector>
+#include <string>
+
+namespace ygo {
+
+#define REPLAY_LIBRARY_ID		0x6c707279
+#define REPLAY_LIBRARY_VERSION	1
+// replays listed per page of the replay window
+#define REPLAY_LIBRARY_PAGE		100
+
+// what the replay window shows of a replay, valid while the file keeps its size and mtime
+struct ReplayEntry {
+	std::wstring name;
+	unsigned long long size;
+	unsigned long long mtime;
+	ReplayHeader header;
+	bool valid;
+	wchar_t players[4][20];
+	// deck of every player in the order of players, empty in single mode
+	std::vector<int> main[4];
+	std::vector<int> extra[4];
+	// set when the replay was played to the end, winner -1 until then
+	int winner;
+	int turns;
+};
+
+// Cache of the replay headers, player names and decks of ./replay in ./replay/library.dat,
+// so opening the replay window only opens the files that were added or changed since.
+class ReplayLibrary {
+public:
+	static void Refresh();
+	static void Filter(const wchar_t* text);
+	static int GetCount();
+	static ReplayEntry* GetEntry(int index);
+	static void RenameEntry(const wchar_t* oldname, const wchar_t* newname);
+	static void RemoveEntry(const wchar_t* name);
+	static void SetResult(const wchar_t* file, int winner, int turns);
+
+private:
+	static ReplayEntry* FindEntry(const wchar_t* name);
+	static void ScanReplay(ReplayEntry& entry);
+	static bool Load();
+	static void Save();
+
+	static std::vector<ReplayEntry> entries;
+	// indexes of the entries matching the filter
+	static std::vector<int> filtered;
+	static std::wstring filter;
+	static bool loaded;
+};
+
+}
+
+#endif //REPLAY_LIBRARY_H
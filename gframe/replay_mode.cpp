@@ -1,4 +1,5 @@
 #include "replay_mode.h"
+#include "replay_library.h"
 #include "duelclient.h"
 #include "game.h"
 #include "single_mode.h"
@@ -19,6 +20,16 @@ bool ReplayMode::exit_pending = false;
 int ReplayMode::skip_turn = 0;
 int ReplayMode::current_step = 0;
 int ReplayMode::skip_step = 0;
+bool ReplayMode::building_index = false;
+bool ReplayMode::checkpoint_pending = false;
+unsigned short ReplayMode::current_phase = 0;
+unsigned int ReplayMode::batch_count = 0;
+unsigned int ReplayMode::response_count = 0;
+unsigned int ReplayMode::field_disabled = 0;
+std::vector<ReplayHint> ReplayMode::player_hints;
+std::vector<std::pair<char*, unsigned int>> ReplayMode::batch_msgs;
+unsigned char ReplayMode::skip_field[0x4000];
+int ReplayMode::skip_field_len = 0;
 
 bool ReplayMode::StartReplay(int skipturn) {
 	skip_turn = skipturn;
@@ -52,8 +63,12 @@ void ReplayMode::Pause(bool is_pause, bool is_step) {
 bool ReplayMode::ReadReplayResponse() {
 	unsigned char resp[64];
 	bool result = cur_replay.ReadNextResponse(resp);
-	if(result)
+	if(result) {
 		set_responseb(pduel, resp);
+		if(building_index)
+			cur_replay.response_batches.push_back(batch_count);
+		response_count++;
+	}
 	return result;
 }
 int ReplayMode::ReplayThread() {
@@ -66,6 +81,8 @@ int ReplayMode::ReplayThread() {
 	set_script_reader((script_reader)DataManager::ScriptReaderEx);
 	set_card_reader((card_reader)DataManager::CardReader);
 	set_message_handler((message_handler)MessageHandler);
+	building_index = !cur_replay.LoadIndex();
+	ResetCheckpoints();
 	if(!StartDuel()) {
 		EndDuel();
 		return 0;
@@ -92,12 +109,17 @@ int ReplayMode::ReplayThread() {
 	if(mainGame->dInfo.isReplaySkiping)
 		mainGame->gMutex.lock();
 	while (is_continuing && !exit_pending) {
+		if(mainGame->dInfo.isReplaySkiping)
+			SaveSkipField();
 		int result = process(pduel);
 		int len = result & 0xffff;
 		/*int flag = result >> 16;*/
 		if (len > 0) {
 			get_message(pduel, (byte*)engineBuffer);
+			batch_count++;
 			is_continuing = ReplayAnalyze(engineBuffer, len);
+			if(checkpoint_pending && !is_restarting)
+				RecordCheckpoint();
 			if(is_restarting) {
 				mainGame->gMutex.lock();
 				is_restarting = false;
@@ -123,20 +145,19 @@ int ReplayMode::ReplayThread() {
 					Pause(true, false);
 					mainGame->dInfo.isStarted = true;
 					mainGame->dInfo.isFinished = false;
-					mainGame->dInfo.isReplaySkiping = false;
-					mainGame->dField.RefreshAllCards();
-					mainGame->gMutex.unlock();
+					EndSkipping();
 				}
 				skip_step = step;
 				current_step = 0;
-			}
+			} else if(mainGame->dInfo.isReplaySkiping && !building_index)
+				SeekCheckpoint();
 		}
 	}
-	if(mainGame->dInfo.isReplaySkiping) {
-		mainGame->dInfo.isReplaySkiping = false;
-		mainGame->dField.RefreshAllCards();
-		mainGame->gMutex.unlock();
-	}
+	// the index is only complete when the replay was played to the end
+	if(building_index && !exit_pending)
+		cur_replay.SaveIndex();
+	if(mainGame->dInfo.isReplaySkiping)
+		EndSkipping();
 	EndDuel();
 	pduel = 0;
 	is_continuing = true;
@@ -237,6 +258,9 @@ bool ReplayMode::StartDuel() {
 	if (!(rh.flag & REPLAY_UNIFORM))
 		opt |= DUEL_OLD_REPLAY;
 	start_duel(pduel, opt);
+	field_disabled = 0;
+	player_hints.clear();
+	SaveSkipField();
 	return true;
 }
 void ReplayMode::EndDuel() {
@@ -275,6 +299,7 @@ void ReplayMode::Restart(bool refresh) {
 	mainGame->dField.Clear();
 	//mainGame->device->setEventReceiver(&mainGame->dField);
 	cur_replay.Rewind();
+	ResetCheckpoints();
 	//mainGame->dInfo.isFirst = true;
 	mainGame->dInfo.tag_player[0] = false;
 	mainGame->dInfo.tag_player[1] = false;
@@ -295,6 +320,168 @@ void ReplayMode::Undo() {
 	is_restarting = true;
 	Pause(false, false);
 }
+void ReplayMode::ResetCheckpoints() {
+	if(building_index) {
+		cur_replay.checkpoints.clear();
+		cur_replay.checkpoint_hints.clear();
+		cur_replay.response_batches.clear();
+	}
+	checkpoint_pending = false;
+	current_phase = 0;
+	batch_count = 0;
+	response_count = 0;
+}
+void ReplayMode::RecordCheckpoint() {
+	checkpoint_pending = false;
+	if(!building_index)
+		return;
+	ReplayCheckpoint cp;
+	cp.batch = batch_count;
+	cp.step = current_step;
+	cp.responses = response_count;
+	cp.turn = mainGame->dInfo.turn;
+	cp.phase = current_phase;
+	cp.tag_player[0] = mainGame->dInfo.tag_player[0];
+	cp.tag_player[1] = mainGame->dInfo.tag_player[1];
+	cp.reserved[0] = 0;
+	cp.reserved[1] = 0;
+	cp.field_disabled = field_disabled;
+	cp.hint_start = (unsigned int)cur_replay.checkpoint_hints.size();
+	cp.hint_count = (unsigned int)player_hints.size();
+	cur_replay.checkpoint_hints.insert(cur_replay.checkpoint_hints.end(), player_hints.begin(), player_hints.end());
+	cur_replay.checkpoints.push_back(cp);
+}
+bool ReplayMode::SeekCheckpoint() {
+	// the last checkpoint before the skip target, the skipping itself has to end it
+	const ReplayCheckpoint* target = 0;
+	for(auto cit = cur_replay.checkpoints.begin(); cit != cur_replay.checkpoints.end(); ++cit) {
+		if(cit->batch <= batch_count)
+			continue;
+		if(skip_step && cit->step >= (unsigned int)(current_step + skip_step))
+			break;
+		if(skip_turn && cit->turn >= mainGame->dInfo.turn + skip_turn)
+			break;
+		if(!skip_step && !skip_turn)
+			break;
+		target = &*cit;
+	}
+	if(!target)
+		return false;
+	// only the engine runs up to the checkpoint, the recorded batches tell when it takes a response
+	char engineBuffer[0x1000];
+	const std::vector<unsigned int>& batches = cur_replay.response_batches;
+	bool ok = true;
+	while(ok && batch_count < target->batch && !exit_pending) {
+		int result = process(pduel);
+		int len = result & 0xffff;
+		if(len <= 0)
+			continue;
+		get_message(pduel, (byte*)engineBuffer);
+		batch_count++;
+		while(ok && response_count < batches.size() && batches[response_count] == batch_count)
+			ok = ReadReplayResponse();
+	}
+	// a stale index is not used again, the field rebuilt by EndSkipping still matches the engine
+	if(!ok || response_count != target->responses)
+		cur_replay.checkpoints.clear();
+	if(skip_step)
+		skip_step -= target->step - current_step;
+	if(skip_turn)
+		skip_turn -= target->turn - mainGame->dInfo.turn;
+	current_step = target->step;
+	current_phase = target->phase;
+	mainGame->dInfo.turn = target->turn;
+	mainGame->dInfo.tag_player[0] = target->tag_player[0] != 0;
+	mainGame->dInfo.tag_player[1] = target->tag_player[1] != 0;
+	field_disabled = target->field_disabled;
+	auto hint = cur_replay.checkpoint_hints.begin() + target->hint_start;
+	player_hints.assign(hint, hint + target->hint_count);
+	return true;
+}
+void ReplayMode::ClientAnalyze(char* msg, unsigned int len) {
+	char* pbuf = msg + 1;
+	if(msg[0] == MSG_FIELD_DISABLED) {
+		field_disabled = BufferIO::ReadInt32(pbuf);
+	} else if(msg[0] == MSG_PLAYER_HINT) {
+		ReplayHint hint;
+		hint.player = BufferIO::ReadInt8(pbuf);
+		int chtype = BufferIO::ReadInt8(pbuf);
+		hint.desc = BufferIO::ReadInt32(pbuf);
+		if(chtype == PHINT_DESC_ADD) {
+			hint.reserved[0] = hint.reserved[1] = hint.reserved[2] = 0;
+			player_hints.push_back(hint);
+		} else if(chtype == PHINT_DESC_REMOVE) {
+			for(auto hit = player_hints.begin(); hit != player_hints.end(); ++hit) {
+				if(hit->player == hint.player && hit->desc == hint.desc) {
+					player_hints.erase(hit);
+					break;
+				}
+			}
+		}
+	}
+	if(!mainGame->dInfo.isReplaySkiping) {
+		DuelClient::ClientAnalyze(msg, len);
+		return;
+	}
+	// fast-forward: the field is rebuilt from the engine by EndSkipping,
+	// only the turn is kept here
+	batch_msgs.push_back(std::make_pair(msg, len));
+	switch(msg[0]) {
+	case MSG_NEW_TURN: {
+		int player = mainGame->LocalPlayer(msg[1]);
+		mainGame->dInfo.turn++;
+		if(mainGame->dInfo.isTag && mainGame->dInfo.turn != 1)
+			mainGame->dInfo.tag_player[player] = !mainGame->dInfo.tag_player[player];
+		break;
+	}
+	}
+}
+void ReplayMode::EndSkipping() {
+	// the engine is already at the end of the batch, so the field is rebuilt as it was before the batch
+	// and the messages of the batch that were passed are applied on top
+	mainGame->gMutex.unlock();
+	DuelClient::ClientAnalyze((char*)skip_field, skip_field_len);
+	mainGame->gMutex.lock();
+	if(current_phase) {
+		char msg[3];
+		char* pbuf = msg;
+		BufferIO::WriteInt8(pbuf, MSG_NEW_PHASE);
+		BufferIO::WriteInt16(pbuf, current_phase);
+		DuelClient::ClientAnalyze(msg, 3);
+	}
+	for(auto& bm : batch_msgs) {
+		int type = bm.first[0];
+		if(type == MSG_NEW_TURN || type == MSG_FIELD_DISABLED || type == MSG_PLAYER_HINT)
+			continue;
+		if(type == MSG_RELOAD_FIELD)
+			mainGame->gMutex.unlock();
+		DuelClient::ClientAnalyze(bm.first, bm.second);
+		if(type == MSG_RELOAD_FIELD)
+			mainGame->gMutex.lock();
+	}
+	batch_msgs.clear();
+	ReplayReload();
+	char msg[7];
+	char* pbuf = msg;
+	BufferIO::WriteInt8(pbuf, MSG_FIELD_DISABLED);
+	BufferIO::WriteInt32(pbuf, field_disabled);
+	DuelClient::ClientAnalyze(msg, 5);
+	for(auto& hint : player_hints) {
+		pbuf = msg;
+		BufferIO::WriteInt8(pbuf, MSG_PLAYER_HINT);
+		BufferIO::WriteInt8(pbuf, hint.player);
+		BufferIO::WriteInt8(pbuf, PHINT_DESC_ADD);
+		BufferIO::WriteInt32(pbuf, hint.desc);
+		DuelClient::ClientAnalyze(msg, 7);
+	}
+	mainGame->dInfo.isReplaySkiping = false;
+	mainGame->dField.RefreshAllCards();
+	mainGame->gMutex.unlock();
+}
+void ReplayMode::SaveSkipField() {
+	skip_field_len = query_field_info(pduel, skip_field);
+	batch_msgs.clear();
+}
 bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 	char* pbuf = msg;
 	int player, count;
@@ -317,11 +504,8 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 		mainGame->dInfo.curMsg = BufferIO::ReadUInt8(pbuf);
 		switch (mainGame->dInfo.curMsg) {
 		case MSG_RETRY: {
-			if(mainGame->dInfo.isReplaySkiping) {
-				mainGame->dInfo.isReplaySkiping = false;
-				mainGame->dField.RefreshAllCards();
-				mainGame->gMutex.unlock();
-			}
+			if(mainGame->dInfo.isReplaySkiping)
+				EndSkipping();
 			mainGame->gMutex.lock();
 			mainGame->stMessage->setText(L"Error occurs.");
 			mainGame->PopupElement(mainGame->wMessage);
@@ -332,17 +516,17 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 		}
 		case MSG_HINT: {
 			pbuf += 6;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_WIN: {
-			if(mainGame->dInfo.isReplaySkiping) {
-				mainGame->dInfo.isReplaySkiping = false;
-				mainGame->dField.RefreshAllCards();
-				mainGame->gMutex.unlock();
-			}
+			if(mainGame->dInfo.isReplaySkiping)
+				EndSkipping();
+			mainGame->gMutex.lock();
+			ReplayLibrary::SetResult(cur_replay.replay_name, pbuf[0], mainGame->dInfo.turn);
+			mainGame->gMutex.unlock();
 			pbuf += 2;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			return false;
 		}
 		case MSG_SELECT_BATTLECMD: {
@@ -448,26 +632,26 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 			player = BufferIO::ReadInt8(pbuf);
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 7;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_CONFIRM_EXTRATOP: {
 			player = BufferIO::ReadInt8(pbuf);
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 7;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_CONFIRM_CARDS: {
 			player = BufferIO::ReadInt8(pbuf);
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 7;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_SHUFFLE_DECK: {
 			player = BufferIO::ReadInt8(pbuf);
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefreshDeck(player);
 			break;
 		}
@@ -475,61 +659,60 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 			/*int oplayer = */BufferIO::ReadInt8(pbuf);
 			int count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 4;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_SHUFFLE_EXTRA: {
 			/*int oplayer = */BufferIO::ReadInt8(pbuf);
 			int count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 4;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_REFRESH_DECK: {
 			pbuf++;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_SWAP_GRAVE_DECK: {
 			player = BufferIO::ReadInt8(pbuf);
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefreshGrave(player);
 			break;
 		}
 		case MSG_REVERSE_DECK: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefreshDeck(0);
 			ReplayRefreshDeck(1);
 			break;
 		}
 		case MSG_DECK_TOP: {
 			pbuf += 6;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_SHUFFLE_SET_CARD: {
 			pbuf++;
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_NEW_TURN: {
+			checkpoint_pending = true;
 			if(skip_turn) {
 				skip_turn--;
-				if(skip_turn == 0) {
-					mainGame->dInfo.isReplaySkiping = false;
-					mainGame->dField.RefreshAllCards();
-					mainGame->gMutex.unlock();
-				}
+				if(skip_turn == 0)
+					EndSkipping();
 			}
 			player = BufferIO::ReadInt8(pbuf);
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_NEW_PHASE: {
-			pbuf += 2;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			checkpoint_pending = true;
+			current_phase = BufferIO::ReadInt16(pbuf);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			break;
 		}
@@ -543,7 +726,7 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 			int cs = pbuf[10];
 			/*int cp = pbuf[11];*/
 			pbuf += 16;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			if(cl && !(cl & 0x80) && (pl != cl || pc != cc))
 				ReplayRefreshSingle(cc, cl, cs);
 			else if(pl == cl && cl == LOCATION_DECK)
@@ -552,97 +735,97 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 		}
 		case MSG_POS_CHANGE: {
 			pbuf += 9;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_SET: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_SWAP: {
 			pbuf += 16;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_FIELD_DISABLED: {
 			pbuf += 4;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_SUMMONING: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_SUMMONED: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			break;
 		}
 		case MSG_SPSUMMONING: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_SPSUMMONED: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			break;
 		}
 		case MSG_FLIPSUMMONING: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_FLIPSUMMONED: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			break;
 		}
 		case MSG_CHAINING: {
 			pbuf += 16;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_CHAINED: {
 			pbuf++;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			break;
 		}
 		case MSG_CHAIN_SOLVING: {
 			pbuf++;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_CHAIN_SOLVED: {
 			pbuf++;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			pauseable = false;
 			break;
 		}
 		case MSG_CHAIN_END: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			pauseable = false;
 			break;
 		}
 		case MSG_CHAIN_NEGATED: {
 			pbuf++;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_CHAIN_DISABLED: {
 			pbuf++;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_CARD_SELECTED:
@@ -650,122 +833,122 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 			player = BufferIO::ReadInt8(pbuf);
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 4;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_BECOME_TARGET: {
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 4;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_DRAW: {
 			player = BufferIO::ReadInt8(pbuf);
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count * 4;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_DAMAGE: {
 			pbuf += 5;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_RECOVER: {
 			pbuf += 5;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_EQUIP: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_LPUPDATE: {
 			pbuf += 5;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_UNEQUIP: {
 			pbuf += 4;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_CARD_TARGET: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_CANCEL_TARGET: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_PAY_LPCOST: {
 			pbuf += 5;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_ADD_COUNTER: {
 			pbuf += 7;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_REMOVE_COUNTER: {
 			pbuf += 7;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_ATTACK: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_BATTLE: {
 			pbuf += 26;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_ATTACK_DISABLED: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			pauseable = false;
 			break;
 		}
 		case MSG_DAMAGE_STEP_START: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			pauseable = false;
 			break;
 		}
 		case MSG_DAMAGE_STEP_END: {
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefresh();
 			pauseable = false;
 			break;
 		}
 		case MSG_MISSED_EFFECT: {
 			pbuf += 8;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_TOSS_COIN: {
 			player = BufferIO::ReadInt8(pbuf);
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_TOSS_DICE: {
 			player = BufferIO::ReadInt8(pbuf);
 			count = BufferIO::ReadInt8(pbuf);
 			pbuf += count;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_ROCK_PAPER_SCISSORS: {
@@ -774,7 +957,7 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 		}
 		case MSG_HAND_RES: {
 			pbuf += 1;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_ANNOUNCE_RACE: {
@@ -796,12 +979,12 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 		}
 		case MSG_CARD_HINT: {
 			pbuf += 9;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_PLAYER_HINT: {
 			pbuf += 6;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			break;
 		}
 		case MSG_MATCH_KILL: {
@@ -811,7 +994,7 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 		case MSG_TAG_SWAP: {
 			player = pbuf[0];
 			pbuf += pbuf[2] * 4 + pbuf[4] * 4 + 9;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
+			ClientAnalyze(offset, pbuf - offset);
 			ReplayRefreshDeck(player);
 			ReplayRefreshExtra(player);
 			break;
@@ -833,9 +1016,11 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 				pbuf += 6;
 			}
 			pbuf++;
-			DuelClient::ClientAnalyze(offset, pbuf - offset);
-			ReplayReload();
-			mainGame->dField.RefreshAllCards();
+			ClientAnalyze(offset, pbuf - offset);
+			if(!mainGame->dInfo.isReplaySkiping) {
+				ReplayReload();
+				mainGame->dField.RefreshAllCards();
+			}
 			break;
 		}
 		case MSG_AI_NAME: {
@@ -857,9 +1042,7 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 					Pause(true, false);
 					mainGame->dInfo.isStarted = true;
 					mainGame->dInfo.isFinished = false;
-					mainGame->dInfo.isReplaySkiping = false;
-					mainGame->dField.RefreshAllCards();
-					mainGame->gMutex.unlock();
+					EndSkipping();
 				}
 			}
 			if(is_pausing) {
@@ -873,6 +1056,8 @@ bool ReplayMode::ReplayAnalyze(char* msg, unsigned int len) {
 	return true;
 }
 void ReplayMode::ReplayRefresh(int flag) {
+	if(mainGame->dInfo.isReplaySkiping)
+		return;
 	unsigned char queryBuffer[0x4000];
 	/*int len = */query_field_card(pduel, 0, LOCATION_MZONE, flag, queryBuffer, 0);
 	mainGame->dField.UpdateFieldCard(mainGame->LocalPlayer(0), LOCATION_MZONE, (char*)queryBuffer);
@@ -888,26 +1073,36 @@ void ReplayMode::ReplayRefresh(int flag) {
 	mainGame->dField.UpdateFieldCard(mainGame->LocalPlayer(1), LOCATION_HAND, (char*)queryBuffer);
 }
 void ReplayMode::ReplayRefreshHand(int player, int flag) {
+	if(mainGame->dInfo.isReplaySkiping)
+		return;
 	unsigned char queryBuffer[0x2000];
 	/*int len = */query_field_card(pduel, player, LOCATION_HAND, flag, queryBuffer, 0);
 	mainGame->dField.UpdateFieldCard(mainGame->LocalPlayer(player), LOCATION_HAND, (char*)queryBuffer);
 }
 void ReplayMode::ReplayRefreshGrave(int player, int flag) {
+	if(mainGame->dInfo.isReplaySkiping)
+		return;
 	unsigned char queryBuffer[0x2000];
 	/*int len = */query_field_card(pduel, player, LOCATION_GRAVE, flag, queryBuffer, 0);
 	mainGame->dField.UpdateFieldCard(mainGame->LocalPlayer(player), LOCATION_GRAVE, (char*)queryBuffer);
 }
 void ReplayMode::ReplayRefreshDeck(int player, int flag) {
+	if(mainGame->dInfo.isReplaySkiping)
+		return;
 	unsigned char queryBuffer[0x2000];
 	/*int len = */query_field_card(pduel, player, LOCATION_DECK, flag, queryBuffer, 0);
 	mainGame->dField.UpdateFieldCard(mainGame->LocalPlayer(player), LOCATION_DECK, (char*)queryBuffer);
 }
 void ReplayMode::ReplayRefreshExtra(int player, int flag) {
+	if(mainGame->dInfo.isReplaySkiping)
+		return;
 	unsigned char queryBuffer[0x2000];
 	/*int len = */query_field_card(pduel, player, LOCATION_EXTRA, flag, queryBuffer, 0);
 	mainGame->dField.UpdateFieldCard(mainGame->LocalPlayer(player), LOCATION_EXTRA, (char*)queryBuffer);
 }
 void ReplayMode::ReplayRefreshSingle(int player, int location, int sequence, int flag) {
+	if(mainGame->dInfo.isReplaySkiping)
+		return;
 	unsigned char queryBuffer[0x4000];
 	/*int len = */query_card(pduel, player, location, sequence, flag, queryBuffer, 0);
 	mainGame->dField.UpdateCard(mainGame->LocalPlayer(player), location, sequence, (char*)queryBuffer);
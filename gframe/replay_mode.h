@@ -22,6 +22,19 @@ private:
 	static int skip_turn;
 	static int current_step;
 	static int skip_step;
+	// seek index state, see Replay::checkpoints
+	static bool building_index;
+	static bool checkpoint_pending;
+	static unsigned short current_phase;
+	static unsigned int batch_count;
+	static unsigned int response_count;
+	// MSG_FIELD_DISABLED and MSG_PLAYER_HINT state of the duel, the field reload at the end of a skip clears them
+	static unsigned int field_disabled;
+	static std::vector<ReplayHint> player_hints;
+	// fast-forward state: the messages of the current batch and the field before it
+	static std::vector<std::pair<char*, unsigned int>> batch_msgs;
+	static unsigned char skip_field[0x4000];
+	static int skip_field_len;
 
 public:
 	static Replay cur_replay;
@@ -37,7 +50,13 @@ public:
 	static void EndDuel();
 	static void Restart(bool refresh);
 	static void Undo();
+	static void ResetCheckpoints();
+	static void RecordCheckpoint();
+	static bool SeekCheckpoint();
 	static bool ReplayAnalyze(char* msg, unsigned int len);
+	static void ClientAnalyze(char* msg, unsigned int len);
+	static void EndSkipping();
+	static void SaveSkipField();
 	
 	static void ReplayRefresh(int flag = 0xf81fff);
 	static void ReplayRefreshHand(int player, int flag = 0x781fff);
@@ -0,0 +1,315 @@
+#include "replay_writer.h"
+#include "server_stats.h"
+
+namespace ygo {
+
+struct ReplayJournal {
+	FILE* fp;
+	bool dirty;
+	int level;
+	char file[256];
+	unsigned char props[8];
+	// compressed chunks of the replay and the start of its data with the player names
+	std::vector<unsigned char> comp;
+	std::vector<ReplayChunk> chunks;
+	std::vector<unsigned char> head;
+};
+
+enum {
+	REPLAY_TASK_OPEN,
+	REPLAY_TASK_WRITE,
+	REPLAY_TASK_CHUNK,
+	REPLAY_TASK_CLOSE,
+	REPLAY_TASK_FINISH,
+};
+
+std::atomic<ReplayWriter::Task*> ReplayWriter::pending(0);
+std::atomic<bool> ReplayWriter::running(false);
+std::mutex ReplayWriter::wake_mutex;
+std::condition_variable ReplayWriter::wake;
+bool ReplayWriter::stopping = false;
+char ReplayWriter::archive_dir[256] = "";
+FILE* ReplayWriter::index_fp = 0;
+
+void ReplayWriter::SetArchive(const char* dir) {
+	strncpy(archive_dir, dir, sizeof(archive_dir) - 1);
+	archive_dir[sizeof(archive_dir) - 1] = 0;
+	size_t len = strlen(archive_dir);
+	while(len && (archive_dir[len - 1] == '/' || archive_dir[len - 1] == '\\'))
+		archive_dir[--len] = 0;
+}
+bool ReplayWriter::ArchiveName(unsigned int room_id, unsigned int start_time, int seq, char* name, size_t size) {
+	if(!archive_dir[0])
+		return false;
+	time_t t = start_time;
+	tm lt;
+#ifdef _WIN32
+	localtime_s(&lt, &t);
+#else
+	localtime_r(&t, &lt);
+#endif
+	snprintf(name, size, "%s/%04d%02d%02d/%u-%02d%02d%02d-%d", archive_dir, lt.tm_year + 1900, lt.tm_mon + 1, lt.tm_mday,
+		room_id, lt.tm_hour, lt.tm_min, lt.tm_sec, seq);
+	return true;
+}
+
+ReplayJournal* ReplayWriter::OpenJournal(const char* file, int level) {
+	ReplayJournal* journal = new ReplayJournal;
+	journal->fp = 0;
+	journal->dirty = false;
+	journal->level = level;
+	memset(journal->props, 0, sizeof(journal->props));
+	strncpy(journal->file, file, sizeof(journal->file) - 1);
+	journal->file[sizeof(journal->file) - 1] = 0;
+	Task* task = (Task*)malloc(sizeof(Task));
+	task->type = REPLAY_TASK_OPEN;
+	task->journal = journal;
+	task->job = 0;
+	task->len = 0;
+	Push(task);
+	return journal;
+}
+void ReplayWriter::WriteJournal(ReplayJournal* journal, const void* data, size_t len) {
+	if(!len)
+		return;
+	Task* task = (Task*)malloc(sizeof(Task) + len);
+	task->type = REPLAY_TASK_WRITE;
+	task->journal = journal;
+	task->job = 0;
+	task->len = len;
+	memcpy(task->data, data, len);
+	Push(task);
+}
+void ReplayWriter::WriteChunk(ReplayJournal* journal, const void* data, size_t len) {
+	Task* task = (Task*)malloc(sizeof(Task) + len);
+	task->type = REPLAY_TASK_CHUNK;
+	task->journal = journal;
+	task->job = 0;
+	task->len = len;
+	memcpy(task->data, data, len);
+	Push(task);
+}
+void ReplayWriter::CloseJournal(ReplayJournal* journal) {
+	Task* task = (Task*)malloc(sizeof(Task));
+	task->type = REPLAY_TASK_CLOSE;
+	task->journal = journal;
+	task->job = 0;
+	task->len = 0;
+	Push(task);
+}
+ReplayJob* ReplayWriter::Finish(Replay& replay, event_base* base, event_callback_fn callback, void* arg) {
+	ReplayJob* job = new ReplayJob;
+	job->header = replay.pheader;
+	strcpy(job->archive, replay.archive_name);
+	job->base = base;
+	job->callback = callback;
+	job->arg = arg;
+	job->done = false;
+	Task* task = (Task*)malloc(sizeof(Task));
+	task->type = REPLAY_TASK_FINISH;
+	task->journal = replay.journal;
+	task->job = job;
+	task->len = 0;
+	Push(task);
+	replay.journal = 0;
+	return job;
+}
+void ReplayWriter::Wait(ReplayJob* job) {
+	std::unique_lock<std::mutex> lock(wake_mutex);
+	while(!job->done)
+		wake.wait(lock);
+}
+void ReplayWriter::Stop() {
+	std::unique_lock<std::mutex> lock(wake_mutex);
+	if(!running)
+		return;
+	stopping = true;
+	wake.notify_all();
+	while(running)
+		wake.wait(lock);
+	stopping = false;
+}
+void ReplayWriter::Push(Task* task) {
+	if(!running) {
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		if(!running) {
+			running = true;
+			std::thread(WriterThread).detach();
+		}
+	}
+	Task* head = pending.load(std::memory_order_relaxed);
+	do {
+		task->next = head;
+	} while(!pending.compare_exchange_weak(head, task, std::memory_order_release, std::memory_order_relaxed));
+	// only the push onto an empty queue can find the writer asleep
+	if(!head) {
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		wake.notify_all();
+	}
+}
+void ReplayWriter::WriterThread() {
+	std::vector<ReplayJournal*> dirty;
+	std::vector<Task*> deferred;
+	while(true) {
+		Task* list = pending.exchange(0, std::memory_order_acquire);
+		if(!list) {
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			if(pending.load(std::memory_order_acquire))
+				continue;
+			if(stopping) {
+				if(index_fp) {
+					fclose(index_fp);
+					index_fp = 0;
+				}
+				running = false;
+				wake.notify_all();
+				return;
+			}
+			wake.wait(lock);
+			continue;
+		}
+		// tasks are pushed onto a stack, put them back in order
+		Task* task = 0;
+		while(list) {
+			Task* next = list->next;
+			list->next = task;
+			task = list;
+			list = next;
+		}
+		while(task) {
+			ReplayJournal* journal = task->journal;
+			Task* next = task->next;
+			switch(task->type) {
+			case REPLAY_TASK_OPEN: {
+				journal->fp = fopen(journal->file, "wb");
+				if(!journal->fp) {
+					MakeDirs(journal->file);
+					journal->fp = fopen(journal->file, "wb");
+				}
+				break;
+			}
+			case REPLAY_TASK_WRITE: {
+				if(!journal->fp)
+					break;
+				fwrite(task->data, task->len, 1, journal->fp);
+				if(!journal->dirty) {
+					journal->dirty = true;
+					dirty.push_back(journal);
+				}
+				break;
+			}
+			default: {
+				// compressing and closing waits until the journals are flushed
+				deferred.push_back(task);
+				task = next;
+				continue;
+			}
+			}
+			free(task);
+			task = next;
+		}
+		// group commit: every journal written in this batch is flushed once
+		for(auto journal : dirty) {
+			fflush(journal->fp);
+			journal->dirty = false;
+		}
+		dirty.clear();
+		for(auto task : deferred) {
+			ReplayJournal* journal = task->journal;
+			switch(task->type) {
+			case REPLAY_TASK_CHUNK: {
+				unsigned long long start = ServerStats::Now();
+				if(journal->chunks.empty())
+					journal->head.assign(task->data, task->data + std::min(task->len, (size_t)160));
+				Replay::CompressChunk(task->data, task->len, journal->comp, journal->chunks, journal->props, journal->level);
+				ServerStats::replay_compress_time.Add(ServerStats::Now() - start);
+				break;
+			}
+			case REPLAY_TASK_CLOSE: {
+				if(journal->fp)
+					fclose(journal->fp);
+				delete journal;
+				break;
+			}
+			case REPLAY_TASK_FINISH: {
+				ReplayJob* job = task->job;
+				if(journal) {
+					if(journal->fp)
+						fclose(journal->fp);
+					job->data.swap(journal->comp);
+					memcpy(job->header.props, journal->props, sizeof(job->header.props));
+					Replay::EndChunks(job->header, job->data, journal->chunks, journal->level);
+					if(job->archive[0])
+						SaveArchive(job, journal->head);
+					delete journal;
+				}
+				if(job->base) {
+					timeval tv = {0, 0};
+					event_base_once(job->base, -1, EV_TIMEOUT, job->callback, job, &tv);
+				} else {
+					std::lock_guard<std::mutex> lock(wake_mutex);
+					job->done = true;
+					wake.notify_all();
+				}
+				break;
+			}
+			}
+			free(task);
+		}
+		deferred.clear();
+		if(index_fp)
+			fflush(index_fp);
+	}
+}
+void ReplayWriter::MakeDirs(const char* file) {
+	char dir[256];
+	strncpy(dir, file, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = 0;
+	for(char* p = dir + 1; *p; ++p) {
+		if(*p != '/')
+			continue;
+		*p = 0;
+		if(!FileSystem::IsDirExists(dir))
+			FileSystem::MakeDir(dir);
+		*p = '/';
+	}
+}
+void ReplayWriter::SaveArchive(ReplayJob* job, const std::vector<unsigned char>& raw) {
+	char file[300];
+	snprintf(file, sizeof(file), "%s.yrp", job->archive);
+	FILE* fp = fopen(file, "wb");
+	if(!fp) {
+		MakeDirs(file);
+		fp = fopen(file, "wb");
+		if(!fp)
+			return;
+	}
+	fwrite(&job->header, sizeof(job->header), 1, fp);
+	fwrite(job->data.data(), job->data.size(), 1, fp);
+	fclose(fp);
+	snprintf(file, sizeof(file), "%s.yrpj", job->archive);
+	remove(file);
+	if(!index_fp) {
+		snprintf(file, sizeof(file), "%s/index.txt", archive_dir);
+		index_fp = fopen(file, "a");
+		if(!index_fp)
+			return;
+	}
+	// path start_time end_time flag datasize comp_size names..., tab separated
+	fprintf(index_fp, "%s.yrp\t%u\t%u\t%u\t%u\t%u", job->archive + strlen(archive_dir) + 1, job->header.start_time,
+		(unsigned int)time(0), job->header.flag, job->header.datasize, (unsigned int)job->data.size());
+	int names = (job->header.flag & REPLAY_TAG) ? 4 : 2;
+	for(int i = 0; i < names && raw.size() >= (size_t)(i + 1) * 40; ++i) {
+		wchar_t wname[20];
+		char name[80];
+		BufferIO::CopyWStr((unsigned short*)&raw[i * 40], wname, 20);
+		BufferIO::EncodeUTF8(wname, name);
+		for(char* p = name; *p; ++p)
+			if(*p == '\t' || *p == '\n' || *p == '\r')
+				*p = ' ';
+		fprintf(index_fp, "\t%s", name);
+	}
+	fprintf(index_fp, "\n");
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef REPLAY_WRITER_H
+#define REPLAY_WRITER_H
+
+#include "config.h"
+#include "replay.h"
+#include <event2/event.h>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+
+namespace ygo {
+
+struct ReplayJournal;
+
+// a finished replay built by the writer thread, handed back to the loop of its room,
+// or without a loop marked done for ReplayWriter::Wait
+struct ReplayJob {
+	ReplayHeader header;
+	std::vector<unsigned char> data;
+	char archive[256];
+	event_base* base;
+	event_callback_fn callback;
+	void* arg;
+	bool done;
+};
+
+// Background thread for the duel server and the client: writes the replay journals with one flush per batch
+// and compresses their chunks, so neither blocks the event loops or the duel.
+// With an archive dir every duel is journaled to dir/YYYYMMDD/room-HHMMSS-n.yrpj, which is replaced
+// by room-HHMMSS-n.yrp when the duel ends and listed in dir/index.txt.
+class ReplayWriter {
+public:
+	static void SetArchive(const char* dir);
+	static bool ArchiveName(unsigned int room_id, unsigned int start_time, int seq, char* name, size_t size);
+	static ReplayJournal* OpenJournal(const char* file, int level);
+	static void WriteJournal(ReplayJournal* journal, const void* data, size_t len);
+	static void WriteChunk(ReplayJournal* journal, const void* data, size_t len);
+	static void CloseJournal(ReplayJournal* journal);
+	static ReplayJob* Finish(Replay& replay, event_base* base, event_callback_fn callback, void* arg);
+	static void Wait(ReplayJob* job);
+	static void Stop();
+
+private:
+	struct Task {
+		Task* next;
+		int type;
+		ReplayJournal* journal;
+		ReplayJob* job;
+		size_t len;
+		unsigned char data[1];
+	};
+	static void Push(Task* task);
+	static void WriterThread();
+	static void MakeDirs(const char* file);
+	static void SaveArchive(ReplayJob* job, const std::vector<unsigned char>& raw);
+
+	static std::atomic<Task*> pending;
+	static std::atomic<bool> running;
+	static std::mutex wake_mutex;
+	static std::condition_variable wake;
+	static bool stopping;
+	static char archive_dir[256];
+	static FILE* index_fp;
+};
+
+}
+
+#endif //REPLAY_WRITER_H
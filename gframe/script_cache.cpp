@@ -0,0 +1,227 @@
+#include "script_cache.h"
+#include "myfilesystem.h"
+#include "../lua/lua.h"
+#include "../lua/lauxlib.h"
+#include <stdio.h>
+
+namespace ygo {
+
+bool ScriptCache::enabled = false;
+std::string ScriptCache::cache_file;
+std::vector<byte> ScriptCache::signature;
+std::unordered_map<std::string, ScriptEntry> ScriptCache::scripts;
+std::unordered_map<std::string, StoredScript> ScriptCache::stored;
+std::mutex ScriptCache::scriptMutex;
+
+static FILE* OpenFile(const char* path, const char* mode) {
+#ifdef _WIN32
+	wchar_t fname[256];
+	wchar_t wmode[8];
+	BufferIO::DecodeUTF8(path, fname);
+	BufferIO::DecodeUTF8(mode, wmode);
+	return _wfopen(fname, wmode);
+#else
+	return fopen(path, mode);
+#endif
+}
+static bool GetScriptInfo(const char* path, unsigned long long* size, unsigned long long* mtime) {
+	wchar_t fname[256];
+	BufferIO::DecodeUTF8(path, fname);
+	return FileSystem::GetFileInfo(fname, size, mtime);
+}
+static int ChunkWriter(lua_State* L, const void* p, size_t sz, void* ud) {
+	std::vector<byte>* chunk = (std::vector<byte>*)ud;
+	chunk->insert(chunk->end(), (const byte*)p, (const byte*)p + sz);
+	return 0;
+}
+void ScriptCache::Enable(const char* file) {
+	enabled = true;
+	Compile((const byte*)"", 0, "=", signature);
+	if(!file || !file[0])
+		return;
+	cache_file = file;
+	if(!Load())
+		Rewrite();
+}
+byte* ScriptCache::Read(const char* script_name, const char* first, const char* second, int* slen) {
+	scriptMutex.lock();
+	auto it = scripts.find(script_name);
+	if(it != scripts.end()) {
+		// entries are never changed once added, the chunk stays valid for the engine
+		ScriptEntry& entry = it->second;
+		scriptMutex.unlock();
+		if(!entry.found)
+			return 0;
+		*slen = (int)entry.chunk.size();
+		return entry.chunk.data();
+	}
+	scriptMutex.unlock();
+	ScriptEntry entry;
+	entry.size = 0;
+	entry.mtime = 0;
+	entry.found = false;
+	bool compiled = false;
+	auto sit = stored.find(script_name);
+	const char* paths[2] = { first, second };
+	for(int i = 0; i < 2 && !entry.found; ++i) {
+		if(!GetScriptInfo(paths[i], &entry.size, &entry.mtime))
+			continue;
+		entry.path = paths[i];
+		if(sit != stored.end() && sit->second.path == entry.path && sit->second.size == entry.size && sit->second.mtime == entry.mtime
+			&& ReadStored(sit->second, entry.chunk)) {
+			entry.found = true;
+			break;
+		}
+		std::vector<byte> source;
+		if(!ReadSource(paths[i], source))
+			continue;
+		// a script with a syntax error is kept as source, the engine reports the error on every load as before
+		if(!Compile(source.data(), source.size(), script_name, entry.chunk))
+			entry.chunk.swap(source);
+		entry.found = true;
+		compiled = true;
+	}
+	scriptMutex.lock();
+	auto result = scripts.emplace(script_name, std::move(entry));
+	if(result.second && compiled && !cache_file.empty())
+		Append(script_name, result.first->second);
+	ScriptEntry& cached = result.first->second;
+	scriptMutex.unlock();
+	if(!cached.found)
+		return 0;
+	*slen = (int)cached.chunk.size();
+	return cached.chunk.data();
+}
+bool ScriptCache::Load() {
+	stored.clear();
+	FILE* fp = OpenFile(cache_file.c_str(), "rb");
+	if(!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	long file_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char buf[0x400];
+	char* pbuf = buf;
+	if(fread(buf, 12, 1, fp) != 1 || (unsigned int)BufferIO::ReadInt32(pbuf) != SCRIPT_CACHE_ID || BufferIO::ReadInt32(pbuf) != SCRIPT_CACHE_VERSION
+		|| BufferIO::ReadInt32(pbuf) != (int)signature.size() || signature.size() > sizeof(buf)
+		|| fread(buf, signature.size(), 1, fp) != 1 || memcmp(buf, signature.data(), signature.size())) {
+		fclose(fp);
+		return false;
+	}
+	long replaced = 0;
+	bool damaged = false;
+	for(;;) {
+		unsigned short namelen;
+		if(fread(&namelen, 2, 1, fp) != 1)
+			break;
+		unsigned short pathlen;
+		char name[256];
+		char path[256];
+		if(namelen >= sizeof(name) || fread(name, namelen, 1, fp) != 1 || fread(&pathlen, 2, 1, fp) != 1
+			|| pathlen >= sizeof(path) || fread(path, pathlen, 1, fp) != 1 || fread(buf, 20, 1, fp) != 1) {
+			damaged = true;
+			break;
+		}
+		StoredScript script;
+		script.path.assign(path, pathlen);
+		pbuf = buf;
+		script.size = (unsigned int)BufferIO::ReadInt32(pbuf);
+		script.size |= (unsigned long long)(unsigned int)BufferIO::ReadInt32(pbuf) << 32;
+		script.mtime = (unsigned int)BufferIO::ReadInt32(pbuf);
+		script.mtime |= (unsigned long long)(unsigned int)BufferIO::ReadInt32(pbuf) << 32;
+		script.length = BufferIO::ReadInt32(pbuf);
+		script.offset = ftell(fp);
+		if(script.length <= 0 || script.length > file_size - script.offset) {
+			damaged = true;
+			break;
+		}
+		fseek(fp, script.length, SEEK_CUR);
+		// a script compiled again is appended, the last record wins
+		auto result = stored.emplace(std::string(name, namelen), script);
+		if(!result.second) {
+			replaced += 24 + namelen + result.first->second.path.size() + result.first->second.length;
+			result.first->second = std::move(script);
+		}
+	}
+	fclose(fp);
+	// a damaged file, or one mostly made of replaced records, is started over
+	if(damaged || replaced > file_size / 2) {
+		stored.clear();
+		return false;
+	}
+	return true;
+}
+bool ScriptCache::ReadStored(const StoredScript& script, std::vector<byte>& chunk) {
+	FILE* fp = OpenFile(cache_file.c_str(), "rb");
+	if(!fp)
+		return false;
+	chunk.resize(script.length);
+	bool ok = fseek(fp, script.offset, SEEK_SET) == 0 && fread(chunk.data(), script.length, 1, fp) == 1;
+	fclose(fp);
+	if(!ok)
+		chunk.clear();
+	return ok;
+}
+void ScriptCache::Rewrite() {
+	FILE* fp = OpenFile(cache_file.c_str(), "wb");
+	if(!fp)
+		return;
+	char buf[12];
+	char* pbuf = buf;
+	BufferIO::WriteInt32(pbuf, SCRIPT_CACHE_ID);
+	BufferIO::WriteInt32(pbuf, SCRIPT_CACHE_VERSION);
+	BufferIO::WriteInt32(pbuf, (int)signature.size());
+	fwrite(buf, 12, 1, fp);
+	fwrite(signature.data(), signature.size(), 1, fp);
+	fclose(fp);
+}
+void ScriptCache::Append(const std::string& name, const ScriptEntry& entry) {
+	if(name.size() >= 256 || entry.path.size() >= 256)
+		return;
+	FILE* fp = OpenFile(cache_file.c_str(), "ab");
+	if(!fp)
+		return;
+	std::vector<char> buf(name.size() + entry.path.size() + entry.chunk.size() + 24);
+	char* pbuf = buf.data();
+	BufferIO::WriteInt16(pbuf, (short)name.size());
+	memcpy(pbuf, name.data(), name.size());
+	pbuf += name.size();
+	BufferIO::WriteInt16(pbuf, (short)entry.path.size());
+	memcpy(pbuf, entry.path.data(), entry.path.size());
+	pbuf += entry.path.size();
+	BufferIO::WriteInt32(pbuf, (int)entry.size);
+	BufferIO::WriteInt32(pbuf, (int)(entry.size >> 32));
+	BufferIO::WriteInt32(pbuf, (int)entry.mtime);
+	BufferIO::WriteInt32(pbuf, (int)(entry.mtime >> 32));
+	BufferIO::WriteInt32(pbuf, (int)entry.chunk.size());
+	memcpy(pbuf, entry.chunk.data(), entry.chunk.size());
+	pbuf += entry.chunk.size();
+	fwrite(buf.data(), pbuf - buf.data(), 1, fp);
+	fclose(fp);
+}
+bool ScriptCache::Compile(const byte* source, size_t len, const char* name, std::vector<byte>& chunk) {
+	lua_State* L = luaL_newstate();
+	if(!L)
+		return false;
+	// the chunk keeps its debug info, so script errors still name the file and line
+	bool ok = luaL_loadbuffer(L, (const char*)source, len, name) == LUA_OK;
+	if(ok) {
+		chunk.clear();
+		ok = lua_dump(L, ChunkWriter, &chunk, 0) == 0;
+	}
+	lua_close(L);
+	return ok;
+}
+bool ScriptCache::ReadSource(const char* path, std::vector<byte>& source) {
+	FILE* fp = OpenFile(path, "rb");
+	if(!fp)
+		return false;
+	byte buf[0x1000];
+	size_t len;
+	while((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+		source.insert(source.end(), buf, buf + len);
+	fclose(fp);
+	return true;
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include "config.h"
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <mutex>
+
+namespace ygo {
+
+#define SCRIPT_CACHE_ID			0x63737379
+#define SCRIPT_CACHE_VERSION	1
+
+// what the engine gets for a script name: the Lua bytecode of the file at path,
+// or its source when it does not compile, so the engine reports the error as before
+struct ScriptEntry {
+	std::string path;
+	unsigned long long size;
+	unsigned long long mtime;
+	std::vector<byte> chunk;
+	bool found;
+};
+
+// a record of the cache file, the bytecode is read from offset when the source still matches
+struct StoredScript {
+	std::string path;
+	unsigned long long size;
+	unsigned long long mtime;
+	long offset;
+	int length;
+};
+
+// Scripts read through DataManager::ScriptReaderEx are compiled once and kept as bytecode for the life
+// of the process, so a duel start neither opens nor parses the card scripts loaded by an earlier duel.
+// With a cache file every compiled script is appended there and reused by the next run while the source
+// keeps its path, size and mtime. Scripts changed or added after the first load need a restart.
+class ScriptCache {
+public:
+	static void Enable(const char* file);
+	static byte* Read(const char* script_name, const char* first, const char* second, int* slen);
+
+	static bool enabled;
+
+private:
+	static bool Load();
+	static bool ReadStored(const StoredScript& script, std::vector<byte>& chunk);
+	static void Rewrite();
+	static void Append(const std::string& name, const ScriptEntry& entry);
+	static bool Compile(const byte* source, size_t len, const char* name, std::vector<byte>& chunk);
+	static bool ReadSource(const char* path, std::vector<byte>& source);
+
+	static std::string cache_file;
+	// bytecode header of this build, the cache file is dropped when it differs
+	static std::vector<byte> signature;
+	static std::unordered_map<std::string, ScriptEntry> scripts;
+	// entries of the cache file, checked against the source on their first use
+	static std::unordered_map<std::string, StoredScript> stored;
+	static std::mutex scriptMutex;
+};
+
+}
+
+#endif //SCRIPT_CACHE_H
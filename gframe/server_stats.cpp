@@ -0,0 +1,134 @@
+#include "server_stats.h"
+#include <chrono>
+
+namespace ygo {
+
+StatsHistogram ServerStats::process_time;
+StatsHistogram ServerStats::analyze_time;
+StatsHistogram ServerStats::deck_check_time;
+StatsHistogram ServerStats::replay_write_time;
+StatsHistogram ServerStats::replay_compress_time;
+StatsHistogram ServerStats::output_depth;
+std::atomic<unsigned long long> ServerStats::stoc_packets[256];
+std::atomic<unsigned long long> ServerStats::stoc_bytes[256];
+std::atomic<unsigned long long> ServerStats::shed_observers(0);
+std::atomic<unsigned long long> ServerStats::shed_duelists(0);
+unsigned long long ServerStats::start_time = ServerStats::Now();
+
+// rooms with the most engine time listed in the stats file
+static const size_t STATS_TOP_ROOMS = 20;
+
+static const struct {
+	const char* name;
+	StatsHistogram* hist;
+} stats_histograms[] = {
+	{ "process_microseconds", &ServerStats::process_time },
+	{ "analyze_microseconds", &ServerStats::analyze_time },
+	{ "deck_check_microseconds", &ServerStats::deck_check_time },
+	{ "replay_write_microseconds", &ServerStats::replay_write_time },
+	{ "replay_compress_microseconds", &ServerStats::replay_compress_time },
+	{ "output_buffer_bytes", &ServerStats::output_depth },
+};
+
+StatsHistogram::StatsHistogram(): count(0), sum(0), max(0) {
+	for(int i = 0; i < STATS_BUCKETS; ++i)
+		buckets[i] = 0;
+}
+void StatsHistogram::Add(unsigned long long value) {
+	int i = 0;
+	while(i < STATS_BUCKETS - 1 && (1ULL << i) < value)
+		++i;
+	buckets[i].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+	unsigned long long cur = max.load(std::memory_order_relaxed);
+	while(cur < value && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed));
+}
+unsigned long long ServerStats::Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+bool ServerStats::WriteStats(const char* file, std::vector<RoomStats>& rooms, int connections) {
+	std::sort(rooms.begin(), rooms.end(), [](const RoomStats& a, const RoomStats& b) {
+		return a.engine_time > b.engine_time;
+	});
+	char tmpfile[1024];
+	snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+	FILE* fp = fopen(tmpfile, "w");
+	if(!fp)
+		return false;
+	const char* ext = strrchr(file, '.');
+	if(ext && !mystrncasecmp(ext, ".json", 5))
+		WriteJson(fp, rooms, connections);
+	else
+		WritePrometheus(fp, rooms, connections);
+	fclose(fp);
+#ifdef _WIN32
+	remove(file);
+#endif
+	return rename(tmpfile, file) == 0;
+}
+void ServerStats::WriteJson(FILE* fp, std::vector<RoomStats>& rooms, int connections) {
+	fprintf(fp, "{\n\t\"uptime\": %llu,\n\t\"rooms\": %d,\n\t\"connections\": %d,\n", (Now() - start_time) / 1000000, (int)rooms.size(), connections);
+	fprintf(fp, "\t\"shed_observers\": %llu,\n\t\"shed_duelists\": %llu,\n", shed_observers.load(), shed_duelists.load());
+	for(auto& h : stats_histograms) {
+		fprintf(fp, "\t\"%s\": {\"count\": %llu, \"sum\": %llu, \"max\": %llu, \"buckets\": [", h.name,
+			h.hist->count.load(), h.hist->sum.load(), h.hist->max.load());
+		for(int i = 0; i < STATS_BUCKETS; ++i)
+			fprintf(fp, i ? ", %llu" : "%llu", h.hist->buckets[i].load());
+		fprintf(fp, "]},\n");
+	}
+	fprintf(fp, "\t\"stoc\": {");
+	bool first = true;
+	for(int i = 0; i < 256; ++i) {
+		unsigned long long packets = stoc_packets[i].load();
+		if(!packets)
+			continue;
+		fprintf(fp, "%s\n\t\t\"0x%02x\": {\"packets\": %llu, \"bytes\": %llu}", first ? "" : ",", i, packets, stoc_bytes[i].load());
+		first = false;
+	}
+	fprintf(fp, "\n\t},\n\t\"top_rooms\": [");
+	for(size_t i = 0; i < rooms.size() && i < STATS_TOP_ROOMS; ++i) {
+		fprintf(fp, "%s\n\t\t{\"id\": %u, \"shard\": %u, \"stage\": %d, \"engine_time\": %llu, \"engine_max\": %llu, \"engine_calls\": %llu}",
+			i ? "," : "", rooms[i].id, rooms[i].shard, rooms[i].stage, rooms[i].engine_time, rooms[i].engine_max, rooms[i].engine_calls);
+	}
+	fprintf(fp, "\n\t]\n}\n");
+}
+void ServerStats::WritePrometheus(FILE* fp, std::vector<RoomStats>& rooms, int connections) {
+	fprintf(fp, "# TYPE ygopro_uptime_seconds gauge\nygopro_uptime_seconds %llu\n", (Now() - start_time) / 1000000);
+	fprintf(fp, "# TYPE ygopro_rooms gauge\nygopro_rooms %d\n", (int)rooms.size());
+	fprintf(fp, "# TYPE ygopro_connections gauge\nygopro_connections %d\n", connections);
+	fprintf(fp, "# TYPE ygopro_shed_players_total counter\n");
+	fprintf(fp, "ygopro_shed_players_total{class=\"observer\"} %llu\n", shed_observers.load());
+	fprintf(fp, "ygopro_shed_players_total{class=\"duelist\"} %llu\n", shed_duelists.load());
+	for(auto& h : stats_histograms) {
+		fprintf(fp, "# TYPE ygopro_%s histogram\n", h.name);
+		unsigned long long total = 0;
+		for(int i = 0; i < STATS_BUCKETS - 1; ++i) {
+			total += h.hist->buckets[i].load();
+			fprintf(fp, "ygopro_%s_bucket{le=\"%llu\"} %llu\n", h.name, 1ULL << i, total);
+		}
+		fprintf(fp, "ygopro_%s_bucket{le=\"+Inf\"} %llu\n", h.name, h.hist->count.load());
+		fprintf(fp, "ygopro_%s_sum %llu\n", h.name, h.hist->sum.load());
+		fprintf(fp, "ygopro_%s_count %llu\n", h.name, h.hist->count.load());
+		fprintf(fp, "# TYPE ygopro_%s_max gauge\nygopro_%s_max %llu\n", h.name, h.name, h.hist->max.load());
+	}
+	fprintf(fp, "# TYPE ygopro_stoc_packets_total counter\n");
+	for(int i = 0; i < 256; ++i)
+		if(stoc_packets[i].load())
+			fprintf(fp, "ygopro_stoc_packets_total{type=\"0x%02x\"} %llu\n", i, stoc_packets[i].load());
+	fprintf(fp, "# TYPE ygopro_stoc_bytes_total counter\n");
+	for(int i = 0; i < 256; ++i)
+		if(stoc_packets[i].load())
+			fprintf(fp, "ygopro_stoc_bytes_total{type=\"0x%02x\"} %llu\n", i, stoc_bytes[i].load());
+	fprintf(fp, "# TYPE ygopro_room_engine_microseconds_total counter\n");
+	for(size_t i = 0; i < rooms.size() && i < STATS_TOP_ROOMS; ++i)
+		fprintf(fp, "ygopro_room_engine_microseconds_total{room=\"%u\",shard=\"%u\"} %llu\n", rooms[i].id, rooms[i].shard, rooms[i].engine_time);
+	fprintf(fp, "# TYPE ygopro_room_engine_max_microseconds gauge\n");
+	for(size_t i = 0; i < rooms.size() && i < STATS_TOP_ROOMS; ++i)
+		fprintf(fp, "ygopro_room_engine_max_microseconds{room=\"%u\",shard=\"%u\"} %llu\n", rooms[i].id, rooms[i].shard, rooms[i].engine_max);
+	fprintf(fp, "# TYPE ygopro_room_engine_calls_total counter\n");
+	for(size_t i = 0; i < rooms.size() && i < STATS_TOP_ROOMS; ++i)
+		fprintf(fp, "ygopro_room_engine_calls_total{room=\"%u\",shard=\"%u\"} %llu\n", rooms[i].id, rooms[i].shard, rooms[i].engine_calls);
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include "config.h"
+#include <atomic>
+#include <vector>
+
+namespace ygo {
+
+// bucket i counts values up to 2^i, the last one everything above
+#define STATS_BUCKETS	26
+
+struct StatsHistogram {
+	std::atomic<unsigned long long> count;
+	std::atomic<unsigned long long> sum;
+	std::atomic<unsigned long long> max;
+	std::atomic<unsigned long long> buckets[STATS_BUCKETS];
+
+	StatsHistogram();
+	void Add(unsigned long long value);
+};
+
+struct RoomStats {
+	unsigned int id;
+	unsigned int shard;
+	int stage;
+	unsigned long long engine_time;
+	unsigned long long engine_max;
+	unsigned long long engine_calls;
+};
+
+class ServerStats {
+public:
+	// times are in microseconds
+	static StatsHistogram process_time;
+	static StatsHistogram analyze_time;
+	static StatsHistogram deck_check_time;
+	static StatsHistogram replay_write_time;
+	static StatsHistogram replay_compress_time;
+	static StatsHistogram output_depth;
+	static std::atomic<unsigned long long> stoc_packets[256];
+	static std::atomic<unsigned long long> stoc_bytes[256];
+	static std::atomic<unsigned long long> shed_observers;
+	static std::atomic<unsigned long long> shed_duelists;
+	static unsigned long long start_time;
+
+	static unsigned long long Now();
+	static void CountPacket(unsigned char proto, size_t len) {
+		stoc_packets[proto].fetch_add(1, std::memory_order_relaxed);
+		stoc_bytes[proto].fetch_add(len, std::memory_order_relaxed);
+	}
+	static bool WriteStats(const char* file, std::vector<RoomStats>& rooms, int connections);
+
+private:
+	static void WriteJson(FILE* fp, std::vector<RoomStats>& rooms, int connections);
+	static void WritePrometheus(FILE* fp, std::vector<RoomStats>& rooms, int connections);
+};
+
+}
+
+#endif //SERVER_STATS_H
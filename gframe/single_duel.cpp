@@ -1,6 +1,8 @@
 #include "single_duel.h"
 #include "netserver.h"
+#ifndef YGOPRO_SERVER_MODE
 #include "game.h"
+#endif
 #include "../ocgcore/ocgapi.h"
 #include "../ocgcore/common.h"
 #include "../ocgcore/mtrandom.h"
@@ -8,6 +10,7 @@
 namespace ygo {
 
 SingleDuel::SingleDuel(bool is_match) {
+	replay_job = 0;
 	match_mode = is_match;
 	match_kill = 0;
 	for(int i = 0; i < 2; ++i) {
@@ -18,6 +21,8 @@ SingleDuel::SingleDuel(bool is_match) {
 	memset(match_result, 0, 3);
 }
 SingleDuel::~SingleDuel() {
+	if(replay_job)
+		replay_job->arg = 0;
 }
 void SingleDuel::Chat(DuelPlayer* dp, void* pdata, int len) {
 	STOC_Chat scc;
@@ -91,6 +96,7 @@ void SingleDuel::JoinGame(DuelPlayer* dp, void* pdata, bool is_creater) {
 		}
 	} else {
 		observers.insert(dp);
+		query_cache[2].Clear();
 		dp->type = NETPLAYER_TYPE_OBSERVER;
 		sctc.type |= NETPLAYER_TYPE_OBSERVER;
 		STOC_HS_WatchChange scwc;
@@ -135,7 +141,7 @@ void SingleDuel::JoinGame(DuelPlayer* dp, void* pdata, bool is_creater) {
 void SingleDuel::LeaveGame(DuelPlayer* dp) {
 	if(dp == host_player) {
 		EndDuel();
-		NetServer::StopServer();
+		NetServer::CloseRoom(this);
 	} else if(dp->type == NETPLAYER_TYPE_OBSERVER) {
 		observers.erase(dp);
 		if(duel_stage == DUEL_STAGE_BEGIN) {
@@ -236,6 +242,7 @@ void SingleDuel::ToObserver(DuelPlayer* dp) {
 	ready[dp->type] = false;
 	dp->type = NETPLAYER_TYPE_OBSERVER;
 	observers.insert(dp);
+	query_cache[2].Clear();
 	STOC_TypeChange sctc;
 	sctc.type = (dp == host_player ? 0x10 : 0) | dp->type;
 	NetServer::SendPacketToPlayer(dp, STOC_TYPE_CHANGE, sctc);
@@ -253,7 +260,9 @@ void SingleDuel::PlayerReady(DuelPlayer* dp, bool is_ready) {
 			} else {
 				bool allow_ocg = host_info.rule == 0 || host_info.rule == 2;
 				bool allow_tcg = host_info.rule == 1 || host_info.rule == 2;
+				unsigned long long start = ServerStats::Now();
 				deckerror = deckManager.CheckDeck(pdeck[dp->type], host_info.lflist, allow_ocg, allow_tcg);
+				ServerStats::deck_check_time.Add(ServerStats::Now() - start);
 			}
 		}
 		if(deckerror) {
@@ -397,7 +406,7 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	}
 	dp->state = CTOS_RESPONSE;
 	std::random_device rd;
-	unsigned int seed = rd();
+	unsigned int seed = has_seed ? this->seed : rd();
 	mt19937 rnd(seed);
 	unsigned int duel_seed = rnd.rand();
 	ReplayHeader rh;
@@ -406,7 +415,8 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	rh.flag = REPLAY_UNIFORM;
 	rh.seed = seed;
 	rh.start_time = (unsigned int)time(nullptr);
-	last_replay.BeginRecord();
+	char archive[256];
+	last_replay.BeginJournal(ReplayWriter::ArchiveName(room_id, rh.start_time, duel_count, archive, sizeof(archive)) ? archive : 0);
 	last_replay.WriteHeader(rh);
 	last_replay.WriteData(players[0]->name, 40, false);
 	last_replay.WriteData(players[1]->name, 40, false);
@@ -416,15 +426,19 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	}
 	time_limit[0] = host_info.time_limit;
 	time_limit[1] = host_info.time_limit;
+	NetServer::duel_mutex.lock();
 	set_script_reader((script_reader)DataManager::ScriptReaderEx);
 	set_card_reader((card_reader)DataManager::CardReader);
 	set_message_handler((message_handler)SingleDuel::MessageHandler);
 	pduel = create_duel(duel_seed);
+	NetServer::duel_mutex.unlock();
 	set_player_info(pduel, 0, host_info.start_lp, host_info.start_hand, host_info.draw_count);
 	set_player_info(pduel, 1, host_info.start_lp, host_info.start_hand, host_info.draw_count);
 	int opt = (int)host_info.duel_rule << 16;
 	if(host_info.no_shuffle_deck)
 		opt |= DUEL_PSEUDO_SHUFFLE;
+	if(has_seed)
+		opt = ((int)host_info.duel_rule << 16) | (seed_options & 0xffff);
 	last_replay.WriteInt32(host_info.start_lp, false);
 	last_replay.WriteInt32(host_info.start_hand, false);
 	last_replay.WriteInt32(host_info.draw_count, false);
@@ -432,23 +446,23 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	last_replay.Flush();
 	last_replay.WriteInt32(pdeck[0].main.size(), false);
 	for(int32 i = (int32)pdeck[0].main.size() - 1; i >= 0; --i) {
-		new_card(pduel, pdeck[0].main[i]->first, 0, 0, LOCATION_DECK, 0, POS_FACEDOWN_DEFENSE);
-		last_replay.WriteInt32(pdeck[0].main[i]->first, false);
+		new_card(pduel, pdeck[0].main[i]->code, 0, 0, LOCATION_DECK, 0, POS_FACEDOWN_DEFENSE);
+		last_replay.WriteInt32(pdeck[0].main[i]->code, false);
 	}
 	last_replay.WriteInt32(pdeck[0].extra.size(), false);
 	for(int32 i = (int32)pdeck[0].extra.size() - 1; i >= 0; --i) {
-		new_card(pduel, pdeck[0].extra[i]->first, 0, 0, LOCATION_EXTRA, 0, POS_FACEDOWN_DEFENSE);
-		last_replay.WriteInt32(pdeck[0].extra[i]->first, false);
+		new_card(pduel, pdeck[0].extra[i]->code, 0, 0, LOCATION_EXTRA, 0, POS_FACEDOWN_DEFENSE);
+		last_replay.WriteInt32(pdeck[0].extra[i]->code, false);
 	}
 	last_replay.WriteInt32(pdeck[1].main.size(), false);
 	for(int32 i = (int32)pdeck[1].main.size() - 1; i >= 0; --i) {
-		new_card(pduel, pdeck[1].main[i]->first, 1, 1, LOCATION_DECK, 0, POS_FACEDOWN_DEFENSE);
-		last_replay.WriteInt32(pdeck[1].main[i]->first, false);
+		new_card(pduel, pdeck[1].main[i]->code, 1, 1, LOCATION_DECK, 0, POS_FACEDOWN_DEFENSE);
+		last_replay.WriteInt32(pdeck[1].main[i]->code, false);
 	}
 	last_replay.WriteInt32(pdeck[1].extra.size(), false);
 	for(int32 i = (int32)pdeck[1].extra.size() - 1; i >= 0; --i) {
-		new_card(pduel, pdeck[1].extra[i]->first, 1, 1, LOCATION_EXTRA, 0, POS_FACEDOWN_DEFENSE);
-		last_replay.WriteInt32(pdeck[1].extra[i]->first, false);
+		new_card(pduel, pdeck[1].extra[i]->code, 1, 1, LOCATION_EXTRA, 0, POS_FACEDOWN_DEFENSE);
+		last_replay.WriteInt32(pdeck[1].extra[i]->code, false);
 	}
 	last_replay.Flush();
 	char startbuf[32], *pbuf = startbuf;
@@ -469,6 +483,8 @@ void SingleDuel::TPResult(DuelPlayer* dp, unsigned char tp) {
 	else startbuf[1] = 0x11;
 	for(auto oit = observers.begin(); oit != observers.end(); ++oit)
 		NetServer::SendBufferToPlayer(*oit, STOC_GAME_MSG, startbuf, 19);
+	for(int i = 0; i < 3; ++i)
+		query_cache[i].Clear();
 	RefreshExtra(0);
 	RefreshExtra(1);
 	start_duel(pduel, opt);
@@ -478,19 +494,32 @@ void SingleDuel::Process() {
 	char engineBuffer[0x1000];
 	unsigned int engFlag = 0, engLen = 0;
 	int stop = 0;
+	for(int i = 0; i < 3; ++i)
+		query_cache[i].EndBatch();
+	NetServer::CorkOutput();
 	while (!stop) {
 		if (engFlag == 2)
 			break;
+		unsigned long long start = ServerStats::Now();
 		int result = process(pduel);
+		unsigned long long elapsed = ServerStats::Now() - start;
+		ServerStats::process_time.Add(elapsed);
+		engine_time += elapsed;
+		engine_calls++;
+		if(elapsed > engine_max)
+			engine_max = elapsed;
 		engLen = result & 0xffff;
 		engFlag = result >> 16;
 		if (engLen > 0) {
 			get_message(pduel, (byte*)&engineBuffer);
+			start = ServerStats::Now();
 			stop = Analyze(engineBuffer, engLen);
+			ServerStats::analyze_time.Add(ServerStats::Now() - start);
 		}
 	}
 	if(stop == 2)
 		DuelEndProc();
+	NetServer::FlushOutput();
 }
 void SingleDuel::DuelEndProc() {
 	if(!match_mode) {
@@ -1390,8 +1419,10 @@ int SingleDuel::Analyze(char* msgbuffer, unsigned int len) {
 void SingleDuel::GetResponse(DuelPlayer* dp, void* pdata, unsigned int len) {
 	byte resb[64];
 	memcpy(resb, pdata, len);
-	last_replay.WriteInt8(len);
+	unsigned long long start = ServerStats::Now();
+	last_replay.WriteInt8(len, false);
 	last_replay.WriteData(resb, len);
+	ServerStats::replay_write_time.Add(ServerStats::Now() - start);
 	set_responseb(pduel, resb);
 	players[dp->type]->state = 0xff;
 	if(host_info.time_limit) {
@@ -1406,17 +1437,30 @@ void SingleDuel::EndDuel() {
 	if(!pduel)
 		return;
 	last_replay.EndRecord();
-	char replaybuf[0x2000], *pbuf = replaybuf;
-	memcpy(pbuf, &last_replay.pheader, sizeof(ReplayHeader));
-	pbuf += sizeof(ReplayHeader);
-	memcpy(pbuf, last_replay.comp_data, last_replay.comp_size);
-	NetServer::SendBufferToPlayer(players[0], STOC_REPLAY, replaybuf, sizeof(ReplayHeader) + last_replay.comp_size);
-	NetServer::ReSendToPlayer(players[1]);
+	// STOC_REPLAY is finished off the event loop, anything sent meanwhile has to wait for it
+	NetServer::HoldOutput(players[0], this);
+	NetServer::HoldOutput(players[1], this);
 	for(auto oit = observers.begin(); oit != observers.end(); ++oit)
-		NetServer::ReSendToPlayer(*oit);
+		NetServer::HoldOutput(*oit, this);
+	replay_job = ReplayWriter::Finish(last_replay, event_get_base(etimer), ReplayCompressed, this);
+	NetServer::duel_mutex.lock();
 	end_duel(pduel);
+	NetServer::duel_mutex.unlock();
 	pduel = 0;
 }
+void SingleDuel::ReplayCompressed(evutil_socket_t fd, short events, void* arg) {
+	ReplayJob* job = (ReplayJob*)arg;
+	SingleDuel* sd = (SingleDuel*)job->arg;
+	if(sd) {
+		if(sd->replay_job == job)
+			sd->replay_job = 0;
+		std::vector<char> replaybuf(sizeof(ReplayHeader) + job->data.size());
+		memcpy(replaybuf.data(), &job->header, sizeof(ReplayHeader));
+		memcpy(replaybuf.data() + sizeof(ReplayHeader), job->data.data(), job->data.size());
+		NetServer::ReleaseOutput(sd, STOC_REPLAY, replaybuf.data(), replaybuf.size());
+	}
+	delete job;
+}
 void SingleDuel::WaitforResponse(int playerid) {
 	last_response = playerid;
 	unsigned char msg = MSG_WAITING;
@@ -1441,95 +1485,91 @@ void SingleDuel::TimeConfirm(DuelPlayer* dp) {
 	timeval timeout = {1, 0};
 	event_add(etimer, &timeout);
 }
-void SingleDuel::RefreshMzone(int player, int flag, int use_cache) {
+void SingleDuel::RequestField(DuelPlayer* dp, unsigned char player, unsigned char location) {
+	if(player > 1)
+		return;
+	int pos;
+	if(dp == players[0])
+		pos = 0;
+	else if(dp == players[1])
+		pos = 1;
+	else if(observers.find(dp) != observers.end())
+		pos = 2;
+	else
+		return;
+	int flag;
+	switch(location) {
+	case LOCATION_MZONE:
+		flag = 0x881fff;
+		break;
+	case LOCATION_SZONE:
+		flag = 0x681fff;
+		break;
+	case LOCATION_HAND:
+		flag = 0x681fff | QUERY_POSITION;
+		break;
+	case LOCATION_GRAVE:
+		flag = 0x81fff;
+		break;
+	case LOCATION_EXTRA:
+		// the opponent and observers are never sent the extra deck
+		if(pos != player)
+			return;
+		flag = 0xe81fff;
+		break;
+	default:
+		return;
+	}
+	if(!query_cache[pos].Resync(player, location))
+		return;
+	// a full query to the requester only, observers share one cache and all get it
 	char query_buffer[0x2000];
+	char view_buffer[0x2000];
 	char* qbuf = query_buffer;
 	BufferIO::WriteInt8(qbuf, MSG_UPDATE_DATA);
 	BufferIO::WriteInt8(qbuf, player);
-	BufferIO::WriteInt8(qbuf, LOCATION_MZONE);
-	int len = query_field_card(pduel, player, LOCATION_MZONE, flag, (unsigned char*)qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer, len + 3);
-	int qlen = 0;
-	while(qlen < len) {
-		int clen = BufferIO::ReadInt32(qbuf);
-		qlen += clen;
-		if (clen == 4)
-			continue;
-		if (qbuf[11] & POS_FACEDOWN)
-			memset(qbuf, 0, clen - 4);
-		qbuf += clen - 4;
+	BufferIO::WriteInt8(qbuf, location);
+	int len = query_field_card(pduel, player, location, flag, (unsigned char*)qbuf, 0) + 3;
+	if(pos == player) {
+		SendUpdateData(pos, query_buffer, len);
+		return;
 	}
-	NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer, len + 3);
-	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+	QueryCache::PublicView(query_buffer, len, view_buffer);
+	SendUpdateData(pos, view_buffer, len);
+}
+void SingleDuel::RefreshMzone(int player, int flag, int use_cache) {
+	RefreshLocation(player, LOCATION_MZONE, flag, use_cache);
 }
 void SingleDuel::RefreshSzone(int player, int flag, int use_cache) {
-	char query_buffer[0x2000];
-	char* qbuf = query_buffer;
-	BufferIO::WriteInt8(qbuf, MSG_UPDATE_DATA);
-	BufferIO::WriteInt8(qbuf, player);
-	BufferIO::WriteInt8(qbuf, LOCATION_SZONE);
-	int len = query_field_card(pduel, player, LOCATION_SZONE, flag, (unsigned char*)qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer, len + 3);
-	int qlen = 0;
-	while(qlen < len) {
-		int clen = BufferIO::ReadInt32(qbuf);
-		qlen += clen;
-		if (clen == 4)
-			continue;
-		if (qbuf[11] & POS_FACEDOWN)
-			memset(qbuf, 0, clen - 4);
-		qbuf += clen - 4;
-	}
-	NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer, len + 3);
-	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+	RefreshLocation(player, LOCATION_SZONE, flag, use_cache);
 }
 void SingleDuel::RefreshHand(int player, int flag, int use_cache) {
-	char query_buffer[0x2000];
-	char* qbuf = query_buffer;
-	BufferIO::WriteInt8(qbuf, MSG_UPDATE_DATA);
-	BufferIO::WriteInt8(qbuf, player);
-	BufferIO::WriteInt8(qbuf, LOCATION_HAND);
-	int len = query_field_card(pduel, player, LOCATION_HAND, flag | QUERY_POSITION, (unsigned char*)qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer, len + 3);
-	int qlen = 0;
-	while(qlen < len) {
-		int slen = BufferIO::ReadInt32(qbuf);
-		int qflag = *(int*)qbuf;
-		int offset = 8;
-		if(!(qflag & QUERY_CODE))
-			offset -= 4;
-		unsigned position = ((*(int*)(qbuf + offset)) >> 24) & 0xff;
-		if(!(position & POS_FACEUP))
-			memset(qbuf, 0, slen - 4);
-		qbuf += slen - 4;
-		qlen += slen;
-	}
-	NetServer::SendBufferToPlayer(players[1 - player], STOC_GAME_MSG, query_buffer, len + 3);
-	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+	RefreshLocation(player, LOCATION_HAND, flag | QUERY_POSITION, use_cache);
 }
 void SingleDuel::RefreshGrave(int player, int flag, int use_cache) {
+	RefreshLocation(player, LOCATION_GRAVE, flag, use_cache);
+}
+void SingleDuel::RefreshExtra(int player, int flag, int use_cache) {
 	char query_buffer[0x2000];
 	char* qbuf = query_buffer;
 	BufferIO::WriteInt8(qbuf, MSG_UPDATE_DATA);
 	BufferIO::WriteInt8(qbuf, player);
-	BufferIO::WriteInt8(qbuf, LOCATION_GRAVE);
-	int len = query_field_card(pduel, player, LOCATION_GRAVE, flag, (unsigned char*)qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[0], STOC_GAME_MSG, query_buffer, len + 3);
-	NetServer::ReSendToPlayer(players[1]);
-	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
-		NetServer::ReSendToPlayer(*pit);
+	BufferIO::WriteInt8(qbuf, LOCATION_EXTRA);
+	int len = query_field_card(pduel, player, LOCATION_EXTRA, flag, (unsigned char*)qbuf, use_cache);
+	SendUpdateData(player, query_buffer, len + 3);
 }
-void SingleDuel::RefreshExtra(int player, int flag, int use_cache) {
+void SingleDuel::RefreshLocation(int player, int location, int flag, int use_cache) {
 	char query_buffer[0x2000];
+	char view_buffer[0x2000];
 	char* qbuf = query_buffer;
 	BufferIO::WriteInt8(qbuf, MSG_UPDATE_DATA);
 	BufferIO::WriteInt8(qbuf, player);
-	BufferIO::WriteInt8(qbuf, LOCATION_EXTRA);
-	int len = query_field_card(pduel, player, LOCATION_EXTRA, flag, (unsigned char*)qbuf, use_cache);
-	NetServer::SendBufferToPlayer(players[player], STOC_GAME_MSG, query_buffer, len + 3);
+	BufferIO::WriteInt8(qbuf, location);
+	int len = query_field_card(pduel, player, location, flag, (unsigned char*)qbuf, use_cache) + 3;
+	SendUpdateData(player, query_buffer, len);
+	QueryCache::PublicView(query_buffer, len, view_buffer);
+	SendUpdateData(1 - player, view_buffer, len);
+	SendUpdateData(2, view_buffer, len);
 }
 void SingleDuel::RefreshSingle(int player, int location, int sequence, int flag) {
 	char query_buffer[0x2000];
@@ -1548,12 +1588,30 @@ void SingleDuel::RefreshSingle(int player, int location, int sequence, int flag)
 			NetServer::ReSendToPlayer(*pit);
 	}
 }
+void SingleDuel::SendUpdateData(int pos, char* msg, int len) {
+	char delta_buffer[0x2000];
+	if(pos < 2) {
+		int dlen = query_cache[pos].WriteUpdate(msg, len, delta_buffer);
+		NetServer::SendBufferToPlayer(players[pos], STOC_GAME_MSG, delta_buffer, dlen);
+		return;
+	}
+	if(observers.empty())
+		return;
+	int dlen = query_cache[2].WriteUpdate(msg, len, delta_buffer);
+	NetServer::SendBufferToPlayer(0, STOC_GAME_MSG, delta_buffer, dlen);
+	for(auto pit = observers.begin(); pit != observers.end(); ++pit)
+		NetServer::ReSendToPlayer(*pit);
+}
 int SingleDuel::MessageHandler(long fduel, int type) {
 	if(!enable_log)
 		return 0;
 	char msgbuf[1024];
 	get_log_message(fduel, (byte*)msgbuf);
+#ifdef YGOPRO_SERVER_MODE
+	fprintf(stderr, "%s\n", msgbuf);
+#else
 	mainGame->AddDebugMsg(msgbuf);
+#endif
 	return 0;
 }
 void SingleDuel::SingleTimer(evutil_socket_t fd, short events, void* arg) {
@@ -4,6 +4,8 @@
 #include "config.h"
 #include "network.h"
 #include "replay.h"
+#include "query_cache.h"
+#include "replay_writer.h"
 
 namespace ygo {
 
@@ -27,6 +29,7 @@ public:
 	virtual int Analyze(char* msgbuffer, unsigned int len);
 	virtual void GetResponse(DuelPlayer* dp, void* pdata, unsigned int len);
 	virtual void TimeConfirm(DuelPlayer* dp);
+	virtual void RequestField(DuelPlayer* dp, unsigned char player, unsigned char location);
 	virtual void EndDuel();
 	
 	void DuelEndProc();
@@ -36,9 +39,12 @@ public:
 	void RefreshHand(int player, int flag = 0x681fff, int use_cache = 1);
 	void RefreshGrave(int player, int flag = 0x81fff, int use_cache = 1);
 	void RefreshExtra(int player, int flag = 0xe81fff, int use_cache = 1);
+	void RefreshLocation(int player, int location, int flag, int use_cache);
 	void RefreshSingle(int player, int location, int sequence, int flag = 0xf81fff);
+	void SendUpdateData(int pos, char* msg, int len);
 
 	static int MessageHandler(long fduel, int type);
+	static void ReplayCompressed(evutil_socket_t fd, short events, void* arg);
 	static void SingleTimer(evutil_socket_t fd, short events, void* arg);
 	
 protected:
@@ -50,7 +56,9 @@ protected:
 	unsigned char hand_result[2];
 	unsigned char last_response;
 	std::set<DuelPlayer*> observers;
+	QueryCache query_cache[3];
 	Replay last_replay;
+	ReplayJob* replay_job;
 	bool match_mode;
 	int match_kill;
 	unsigned char duel_count;
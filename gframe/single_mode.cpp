@@ -1,6 +1,7 @@
 #include "single_mode.h"
 #include "duelclient.h"
 #include "game.h"
+#include "replay_writer.h"
 #include "../ocgcore/common.h"
 #include "../ocgcore/mtrandom.h"
 
@@ -101,7 +102,7 @@ int SingleMode::SinglePlayThread() {
 	int len = get_message(pduel, (byte*)engineBuffer);
 	if (len > 0)
 		is_continuing = SinglePlayAnalyze(engineBuffer, len);
-	last_replay.BeginRecord();
+	last_replay.BeginJournal(0);
 	last_replay.WriteHeader(rh);
 	unsigned short buffer[20];
 	BufferIO::CopyWStr(mainGame->dInfo.hostname, buffer, 20);
@@ -126,6 +127,8 @@ int SingleMode::SinglePlayThread() {
 		}
 	}
 	last_replay.EndRecord();
+	// compressed by the replay writer while the save dialog is shown
+	ReplayJob* replay_job = ReplayWriter::Finish(last_replay, 0, 0, 0);
 	mainGame->gMutex.lock();
 	time_t nowtime = time(NULL);
 	tm* localedtime = localtime(&nowtime);
@@ -147,6 +150,10 @@ int SingleMode::SinglePlayThread() {
 		mainGame->gMutex.unlock();
 		mainGame->WaitFrameSignal(30);
 	}
+	ReplayWriter::Wait(replay_job);
+	last_replay.pheader = replay_job->header;
+	last_replay.comp_data.swap(replay_job->data);
+	delete replay_job;
 	if(mainGame->actionParam)
 		last_replay.SaveReplay(mainGame->ebRSName->getText());
 	end_duel(pduel);
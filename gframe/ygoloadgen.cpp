@@ -0,0 +1,565 @@
+#include "config.h"
+#include "network.h"
+#include "replay.h"
+#include <event2/thread.h>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <set>
+#ifndef _WIN32
+#include <signal.h>
+#include <arpa/inet.h>
+#endif
+
+namespace ygo {
+
+// decks and responses of one recorded single duel
+struct ReplayScript {
+	unsigned int seed;
+	unsigned int options;
+	unsigned int start_lp;
+	unsigned char start_hand;
+	unsigned char draw_count;
+	unsigned char duel_rule;
+	std::vector<int> deck[2];
+	std::vector<unsigned char> responses;
+};
+
+struct LoadRoom;
+struct LoadThread;
+
+struct LoadClient {
+	LoadRoom* room;
+	bufferevent* bev;
+	int deck;
+};
+
+struct LoadRoom {
+	LoadThread* thread;
+	ReplayScript* script;
+	LoadClient clients[2];
+	LoadClient* responder;
+	event* etimer;
+	unsigned int gameid;
+	size_t next_response;
+	unsigned long long sent_time;
+	// counted in the totals only when the duel follows the recording to its end
+	bool diverged;
+	unsigned long long messages;
+	unsigned long long bytes;
+	std::vector<unsigned int> latency;
+};
+
+struct LoadThread {
+	event_base* base;
+	std::set<LoadRoom*> rooms;
+	std::vector<unsigned int> latency;
+	std::thread thread;
+};
+
+class LoadGen {
+public:
+	static bool LoadReplay(const char* file);
+	static void Start(int threads);
+	static void Stop();
+	static void Report(bool final);
+
+	static std::vector<ReplayScript> corpus;
+	static sockaddr_in server_addr;
+	static int rooms;
+	static int think_time;
+	static bool use_seed;
+	static std::vector<LoadThread*> workers;
+	static std::atomic<bool> stopping;
+	static unsigned long long start_time;
+	static std::atomic<unsigned int> next_script;
+	static std::atomic<unsigned long long> duels;
+	static std::atomic<unsigned long long> messages;
+	static std::atomic<unsigned long long> bytes;
+	static std::atomic<unsigned long long> diverged;
+	static std::atomic<unsigned long long> errors;
+	static std::atomic<int> active;
+
+private:
+	static void ThreadLoop(LoadThread* lt, int count);
+	static void StartRoom(LoadThread* lt);
+	static void EndRoom(LoadRoom* room);
+	static bool Connect(LoadRoom* room, LoadClient* client);
+	static void SendPacket(LoadClient* client, unsigned char proto, const void* data, size_t len);
+	static void SendDeck(LoadClient* client);
+	static void SendResponse(LoadRoom* room);
+	static bool HandlePacket(LoadClient* client, unsigned char* data, int len);
+	static bool HandleGameMsg(LoadClient* client, unsigned char* msg, int len);
+	static void ClientRead(bufferevent* bev, void* ctx);
+	static void ClientEvent(bufferevent* bev, short events, void* ctx);
+	static void ResponseTimer(evutil_socket_t fd, short events, void* arg);
+	static unsigned long long Now();
+};
+
+std::vector<ReplayScript> LoadGen::corpus;
+sockaddr_in LoadGen::server_addr;
+int LoadGen::rooms = 100;
+int LoadGen::think_time = 0;
+bool LoadGen::use_seed = false;
+std::vector<LoadThread*> LoadGen::workers;
+std::atomic<bool> LoadGen::stopping(false);
+unsigned long long LoadGen::start_time = 0;
+std::atomic<unsigned int> LoadGen::next_script(0);
+std::atomic<unsigned long long> LoadGen::duels(0);
+std::atomic<unsigned long long> LoadGen::messages(0);
+std::atomic<unsigned long long> LoadGen::bytes(0);
+std::atomic<unsigned long long> LoadGen::diverged(0);
+std::atomic<unsigned long long> LoadGen::errors(0);
+std::atomic<int> LoadGen::active(0);
+
+static const wchar_t* LOADGEN_PASS = L"loadgen";
+
+bool LoadGen::LoadReplay(const char* file) {
+	wchar_t wname[256];
+	BufferIO::DecodeUTF8(file, wname);
+	Replay replay;
+	if(!replay.OpenReplay(wname))
+		return false;
+	const ReplayHeader& rh = replay.pheader;
+	if(rh.id != 0x31707279 || (rh.flag & (REPLAY_TAG | REPLAY_SINGLE_MODE)))
+		return false;
+	ReplayScript script;
+	script.seed = rh.seed;
+	wchar_t name[20];
+	replay.ReadName(name);
+	replay.ReadName(name);
+	script.start_lp = replay.ReadInt32();
+	script.start_hand = replay.ReadInt32();
+	script.draw_count = replay.ReadInt32();
+	int opt = replay.ReadInt32();
+	script.duel_rule = opt >> 16;
+	script.options = opt & 0xffff;
+	for(int p = 0; p < 2; ++p) {
+		// the server records decks back to front, CTOS_UPDATE_DECK wants them front to back
+		int main = replay.ReadInt32();
+		if(main < 0 || main > 100)
+			return false;
+		std::vector<int> cards;
+		for(int i = 0; i < main; ++i)
+			cards.insert(cards.begin(), replay.ReadInt32());
+		int extra = replay.ReadInt32();
+		if(extra < 0 || extra > 30)
+			return false;
+		std::vector<int> extra_cards;
+		for(int i = 0; i < extra; ++i)
+			extra_cards.insert(extra_cards.begin(), replay.ReadInt32());
+		cards.insert(cards.end(), extra_cards.begin(), extra_cards.end());
+		script.deck[p].swap(cards);
+	}
+	unsigned char len, resp[64];
+	while(replay.ReadData(&len, 1) && len <= 64 && replay.ReadData(resp, len)) {
+		script.responses.push_back(len);
+		script.responses.insert(script.responses.end(), resp, resp + len);
+	}
+	corpus.push_back(script);
+	return true;
+}
+unsigned long long LoadGen::Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+void LoadGen::Start(int threads) {
+	start_time = Now();
+	for(int i = 0; i < threads; ++i) {
+		LoadThread* lt = new LoadThread;
+		lt->base = event_base_new();
+		int count = rooms / threads + (i < rooms % threads ? 1 : 0);
+		lt->thread = std::thread(ThreadLoop, lt, count);
+		workers.push_back(lt);
+	}
+}
+void LoadGen::Stop() {
+	stopping = true;
+	for(auto lt : workers)
+		event_base_loopexit(lt->base, 0);
+	for(auto lt : workers)
+		lt->thread.join();
+	Report(true);
+	std::vector<unsigned int> latency;
+	for(auto lt : workers) {
+		latency.insert(latency.end(), lt->latency.begin(), lt->latency.end());
+		// rooms still dueling when the run ended are dropped without counting
+		for(auto room : lt->rooms) {
+			for(int i = 0; i < 2; ++i)
+				if(room->clients[i].bev)
+					bufferevent_free(room->clients[i].bev);
+			event_free(room->etimer);
+			delete room;
+		}
+		event_base_free(lt->base);
+		delete lt;
+	}
+	workers.clear();
+	if(latency.empty())
+		return;
+	std::sort(latency.begin(), latency.end());
+	static const double percentiles[] = { 50, 90, 99, 99.9 };
+	fprintf(stdout, "response latency (ms):");
+	for(double p : percentiles)
+		fprintf(stdout, " p%g %.2f", p, latency[(size_t)((latency.size() - 1) * p / 100)] / 1000.0);
+	fprintf(stdout, " max %.2f, %d samples\n", latency.back() / 1000.0, (int)latency.size());
+}
+void LoadGen::Report(bool final) {
+	static unsigned long long last = 0;
+	static unsigned long long last_duels = 0, last_messages = 0, last_bytes = 0;
+	unsigned long long now = Now();
+	unsigned long long cur_duels = duels, cur_messages = messages, cur_bytes = bytes;
+	if(!last)
+		last = start_time;
+	double elapsed = final ? (now - start_time) / 1000000.0 : (now - last) / 1000000.0;
+	if(elapsed <= 0)
+		elapsed = 1;
+	if(final) {
+		fprintf(stdout, "total: %llu duels in %.1fs, %.1f duels/s, %.0f msgs/s, %.2f MB/s, %llu diverged, %llu errors\n",
+			cur_duels, elapsed, cur_duels / elapsed, cur_messages / elapsed, cur_bytes / elapsed / 1048576,
+			diverged.load(), errors.load());
+	} else {
+		fprintf(stdout, "%d rooms, %.1f duels/s, %.0f msgs/s, %.2f MB/s, %llu diverged, %llu errors\n",
+			active.load(), (cur_duels - last_duels) / elapsed, (cur_messages - last_messages) / elapsed,
+			(cur_bytes - last_bytes) / elapsed / 1048576, diverged.load(), errors.load());
+	}
+	fflush(stdout);
+	last = now;
+	last_duels = cur_duels;
+	last_messages = cur_messages;
+	last_bytes = cur_bytes;
+}
+void LoadGen::ThreadLoop(LoadThread* lt, int count) {
+	for(int i = 0; i < count; ++i)
+		StartRoom(lt);
+	event_base_loop(lt->base, EVLOOP_NO_EXIT_ON_EMPTY);
+}
+void LoadGen::StartRoom(LoadThread* lt) {
+	if(stopping)
+		return;
+	LoadRoom* room = new LoadRoom;
+	room->thread = lt;
+	room->script = &corpus[next_script++ % corpus.size()];
+	room->responder = 0;
+	room->etimer = evtimer_new(lt->base, ResponseTimer, room);
+	room->gameid = 0;
+	room->next_response = 0;
+	room->sent_time = 0;
+	room->diverged = false;
+	room->messages = 0;
+	room->bytes = 0;
+	lt->rooms.insert(room);
+	for(int i = 0; i < 2; ++i) {
+		room->clients[i].room = room;
+		room->clients[i].bev = 0;
+		room->clients[i].deck = i;
+	}
+	active++;
+	if(!Connect(room, &room->clients[0])) {
+		EndRoom(room);
+		return;
+	}
+	ReplayScript* script = room->script;
+	CTOS_CreateGame cscg;
+	memset(&cscg, 0, sizeof(cscg));
+	cscg.info.mode = MODE_SINGLE;
+	cscg.info.duel_rule = script->duel_rule;
+	cscg.info.no_check_deck = true;
+	cscg.info.no_shuffle_deck = true;
+	cscg.info.start_lp = script->start_lp;
+	cscg.info.start_hand = script->start_hand;
+	cscg.info.draw_count = script->draw_count;
+	BufferIO::CopyWStr(L"loadgen", cscg.name, 20);
+	BufferIO::CopyWStr(LOADGEN_PASS, cscg.pass, 20);
+	SendPacket(&room->clients[0], CTOS_CREATE_GAME, &cscg, sizeof(cscg));
+	if(use_seed) {
+		CTOS_DuelSeed csds;
+		csds.seed = script->seed;
+		csds.options = script->options;
+		SendPacket(&room->clients[0], CTOS_DUEL_SEED, &csds, sizeof(csds));
+	}
+	SendDeck(&room->clients[0]);
+	SendPacket(&room->clients[0], CTOS_HS_READY, 0, 0);
+}
+void LoadGen::EndRoom(LoadRoom* room) {
+	LoadThread* lt = room->thread;
+	for(int i = 0; i < 2; ++i)
+		if(room->clients[i].bev)
+			bufferevent_free(room->clients[i].bev);
+	event_free(room->etimer);
+	lt->rooms.erase(room);
+	delete room;
+	active--;
+	StartRoom(lt);
+}
+bool LoadGen::Connect(LoadRoom* room, LoadClient* client) {
+	client->bev = bufferevent_socket_new(room->thread->base, -1, BEV_OPT_CLOSE_ON_FREE);
+	bufferevent_setcb(client->bev, ClientRead, NULL, ClientEvent, client);
+	bufferevent_enable(client->bev, EV_READ);
+	if(bufferevent_socket_connect(client->bev, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+		errors++;
+		return false;
+	}
+	CTOS_PlayerInfo cspi;
+	BufferIO::CopyWStr(client->deck ? L"guest" : L"host", cspi.name, 20);
+	SendPacket(client, CTOS_PLAYER_INFO, &cspi, sizeof(cspi));
+	return true;
+}
+void LoadGen::SendPacket(LoadClient* client, unsigned char proto, const void* data, size_t len) {
+	char header[3], *p = header;
+	BufferIO::WriteInt16(p, (short)(len + 1));
+	BufferIO::WriteInt8(p, proto);
+	evbuffer* output = bufferevent_get_output(client->bev);
+	evbuffer_add(output, header, 3);
+	if(len)
+		evbuffer_add(output, data, len);
+}
+void LoadGen::SendDeck(LoadClient* client) {
+	std::vector<int>& deck = client->room->script->deck[client->deck];
+	std::vector<int> buf;
+	buf.push_back((int)deck.size());
+	buf.push_back(0);
+	buf.insert(buf.end(), deck.begin(), deck.end());
+	SendPacket(client, CTOS_UPDATE_DECK, buf.data(), buf.size() * sizeof(int));
+}
+void LoadGen::SendResponse(LoadRoom* room) {
+	LoadClient* client = room->responder;
+	room->responder = 0;
+	std::vector<unsigned char>& responses = room->script->responses;
+	if(room->next_response >= responses.size()) {
+		// the recording ends at a prompt, it was surrendered or disconnected there
+		SendPacket(client, CTOS_SURRENDER, 0, 0);
+		return;
+	}
+	int len = responses[room->next_response];
+	SendPacket(client, CTOS_RESPONSE, &responses[room->next_response + 1], len);
+	room->next_response += len + 1;
+	room->sent_time = Now();
+}
+void LoadGen::ResponseTimer(evutil_socket_t fd, short events, void* arg) {
+	LoadRoom* room = (LoadRoom*)arg;
+	if(room->responder)
+		SendResponse(room);
+}
+bool LoadGen::HandleGameMsg(LoadClient* client, unsigned char* msg, int len) {
+	LoadRoom* room = client->room;
+	room->messages++;
+	if(room->sent_time) {
+		room->latency.push_back((unsigned int)(Now() - room->sent_time));
+		room->sent_time = 0;
+	}
+	switch(msg[0]) {
+	case MSG_RETRY: {
+		// the engine rolled differently than in the recording, the rest of the script no longer fits
+		room->diverged = true;
+		SendPacket(client, CTOS_SURRENDER, 0, 0);
+		break;
+	}
+	case MSG_SELECT_BATTLECMD:
+	case MSG_SELECT_IDLECMD:
+	case MSG_SELECT_EFFECTYN:
+	case MSG_SELECT_YESNO:
+	case MSG_SELECT_OPTION:
+	case MSG_SELECT_CARD:
+	case MSG_SELECT_CHAIN:
+	case MSG_SELECT_PLACE:
+	case MSG_SELECT_POSITION:
+	case MSG_SELECT_TRIBUTE:
+	case MSG_SORT_CHAIN:
+	case MSG_SELECT_COUNTER:
+	case MSG_SELECT_SUM:
+	case MSG_SELECT_DISFIELD:
+	case MSG_SORT_CARD:
+	case MSG_SELECT_UNSELECT_CARD:
+	case MSG_ROCK_PAPER_SCISSORS:
+	case MSG_ANNOUNCE_RACE:
+	case MSG_ANNOUNCE_ATTRIB:
+	case MSG_ANNOUNCE_CARD:
+	case MSG_ANNOUNCE_NUMBER: {
+		room->responder = client;
+		if(think_time) {
+			timeval tv = { think_time / 1000, (think_time % 1000) * 1000 };
+			event_add(room->etimer, &tv);
+		} else
+			SendResponse(room);
+		break;
+	}
+	}
+	return true;
+}
+bool LoadGen::HandlePacket(LoadClient* client, unsigned char* data, int len) {
+	LoadRoom* room = client->room;
+	unsigned char proto = data[0];
+	unsigned char* pdata = data + 1;
+	switch(proto) {
+	case STOC_GAME_MSG: {
+		if(len < 2)
+			break;
+		return HandleGameMsg(client, pdata, len - 1);
+	}
+	case STOC_ERROR_MSG: {
+		errors++;
+		EndRoom(room);
+		return false;
+	}
+	case STOC_CREATE_GAME: {
+		room->gameid = ((STOC_CreateGame*)pdata)->gameid;
+		LoadClient* guest = &room->clients[1];
+		if(!Connect(room, guest)) {
+			EndRoom(room);
+			return false;
+		}
+		CTOS_JoinGame csjg;
+		memset(&csjg, 0, sizeof(csjg));
+		csjg.version = PRO_VERSION;
+		csjg.gameid = room->gameid;
+		BufferIO::CopyWStr(LOADGEN_PASS, csjg.pass, 20);
+		SendPacket(guest, CTOS_JOIN_GAME, &csjg, sizeof(csjg));
+		SendDeck(guest);
+		SendPacket(guest, CTOS_HS_READY, 0, 0);
+		break;
+	}
+	case STOC_HS_PLAYER_CHANGE: {
+		STOC_HS_PlayerChange* pkt = (STOC_HS_PlayerChange*)pdata;
+		if(client == &room->clients[0] && (pkt->status >> 4) == 1 && (pkt->status & 0xf) == PLAYERCHANGE_READY)
+			SendPacket(client, CTOS_HS_START, 0, 0);
+		break;
+	}
+	case STOC_SELECT_HAND: {
+		CTOS_HandResult cshr;
+		cshr.res = rand() % 3 + 1;
+		SendPacket(client, CTOS_HAND_RESULT, &cshr, sizeof(cshr));
+		break;
+	}
+	case STOC_SELECT_TP: {
+		// the recording was made with the owner of deck 0 going first
+		CTOS_TPResult cstr;
+		cstr.res = client->deck == 0 ? 1 : 0;
+		SendPacket(client, CTOS_TP_RESULT, &cstr, sizeof(cstr));
+		break;
+	}
+	case STOC_TIME_LIMIT: {
+		SendPacket(client, CTOS_TIME_CONFIRM, 0, 0);
+		break;
+	}
+	case STOC_DUEL_END: {
+		// a duel decided before the recording ran out did not follow it either
+		if(room->diverged || room->next_response < room->script->responses.size()) {
+			diverged++;
+		} else {
+			duels++;
+			messages += room->messages;
+			bytes += room->bytes;
+			std::vector<unsigned int>& latency = room->thread->latency;
+			latency.insert(latency.end(), room->latency.begin(), room->latency.end());
+		}
+		EndRoom(room);
+		return false;
+	}
+	}
+	return true;
+}
+void LoadGen::ClientRead(bufferevent* bev, void* ctx) {
+	LoadClient* client = (LoadClient*)ctx;
+	evbuffer* input = bufferevent_get_input(bev);
+	unsigned char buffer[0x10000];
+	unsigned short packet_len;
+	while(true) {
+		size_t len = evbuffer_get_length(input);
+		if(len < 2)
+			return;
+		evbuffer_copyout(input, &packet_len, 2);
+		if(len < (size_t)packet_len + 2)
+			return;
+		evbuffer_drain(input, 2);
+		evbuffer_remove(input, buffer, packet_len);
+		client->room->bytes += packet_len + 2;
+		if(packet_len && !HandlePacket(client, buffer, packet_len))
+			return;
+	}
+}
+void LoadGen::ClientEvent(bufferevent* bev, short events, void* ctx) {
+	LoadClient* client = (LoadClient*)ctx;
+	if(events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+		errors++;
+		EndRoom(client->room);
+	}
+}
+
+}
+
+int main(int argc, char* argv[]) {
+#ifndef _WIN32
+	setlocale(LC_CTYPE, "UTF-8");
+	signal(SIGPIPE, SIG_IGN);
+#endif
+#ifdef _WIN32
+	WORD wVersionRequested;
+	WSADATA wsaData;
+	wVersionRequested = MAKEWORD(2, 2);
+	WSAStartup(wVersionRequested, &wsaData);
+	evthread_use_windows_threads();
+#else
+	evthread_use_pthreads();
+#endif //_WIN32
+	const char* host = "127.0.0.1";
+	int port = 7911;
+	int threads = 1;
+	int duration = 60;
+	std::vector<const char*> files;
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "-h") && i + 1 < argc) { // Server address
+			host = argv[++i];
+		} else if(!strcmp(argv[i], "-p") && i + 1 < argc) { // Port
+			port = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-r") && i + 1 < argc) { // Concurrent rooms
+			ygo::LoadGen::rooms = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-w") && i + 1 < argc) { // Client threads
+			threads = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-t") && i + 1 < argc) { // Seconds to run
+			duration = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-d") && i + 1 < argc) { // Milliseconds before each response
+			ygo::LoadGen::think_time = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-s")) { // Duel with the recorded seed, needs accept_seed on the server
+			ygo::LoadGen::use_seed = true;
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+	for(auto file : files) {
+		if(FileSystem::IsDirExists(file)) {
+			FileSystem::TraversalDir(file, [file](const char* name, bool isdir) {
+				if(!isdir && strrchr(name, '.') && !mystrncasecmp(strrchr(name, '.'), ".yrp", 4)) {
+					char fpath[1024];
+					sprintf(fpath, "%s/%s", file, name);
+					ygo::LoadGen::LoadReplay(fpath);
+				}
+			});
+		} else if(!ygo::LoadGen::LoadReplay(file))
+			fprintf(stderr, "Skipped %s\n", file);
+	}
+	if(ygo::LoadGen::corpus.empty()) {
+		fprintf(stderr, "Usage: ygoloadgen [-h host] [-p port] [-r rooms] [-w threads] [-t seconds] [-d ms] [-s] replay.yrp|dir ...\n");
+		return EXIT_FAILURE;
+	}
+	if(threads < 1)
+		threads = 1;
+	if(ygo::LoadGen::rooms < threads)
+		ygo::LoadGen::rooms = threads;
+	sockaddr_in& addr = ygo::LoadGen::server_addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr(host);
+	fprintf(stderr, "%d replays, %d rooms on %d thread(s) against %s:%d for %ds\n",
+		(int)ygo::LoadGen::corpus.size(), ygo::LoadGen::rooms, threads, host, port, duration);
+	ygo::LoadGen::Start(threads);
+	for(int i = 0; i < duration; ++i) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		ygo::LoadGen::Report(false);
+	}
+	ygo::LoadGen::Stop();
+#ifdef _WIN32
+	WSACleanup();
+#endif //_WIN32
+	return EXIT_SUCCESS;
+}
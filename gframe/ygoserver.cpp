@@ -0,0 +1,165 @@
+#include "config.h"
+#include "data_manager.h"
+#include "deck_manager.h"
+#include "netserver.h"
+#include "replay_writer.h"
+#include "script_cache.h"
+#include <event2/thread.h>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+int enable_log = 0;
+
+struct ServerConfig {
+	unsigned short port;
+	unsigned int workers;
+	int prefer_expansion_script;
+	char stats_file[256];
+	int stats_interval;
+	int duelist_high_water;
+	int observer_high_water;
+	char replay_dir[256];
+	int replay_compression;
+	int script_cache;
+	char script_cache_file[256];
+	int accept_seed;
+};
+
+static void LoadServerConfig(const char* file, ServerConfig& conf) {
+	FILE* fp = fopen(file, "r");
+	if(!fp)
+		return;
+	char linebuf[256];
+	char strbuf[32];
+	char valbuf[256];
+	while(fgets(linebuf, 256, fp)) {
+		if(sscanf(linebuf, "%31s = %255s", strbuf, valbuf) != 2)
+			continue;
+		if(!strcmp(strbuf, "serverport")) {
+			conf.port = atoi(valbuf);
+		} else if(!strcmp(strbuf, "workers")) {
+			conf.workers = atoi(valbuf);
+		} else if(!strcmp(strbuf, "prefer_expansion_script")) {
+			conf.prefer_expansion_script = atoi(valbuf);
+		} else if(!strcmp(strbuf, "enable_log")) {
+			enable_log = atoi(valbuf);
+		} else if(!strcmp(strbuf, "stats_file")) {
+			strcpy(conf.stats_file, valbuf);
+		} else if(!strcmp(strbuf, "stats_interval")) {
+			conf.stats_interval = atoi(valbuf);
+		} else if(!strcmp(strbuf, "duelist_high_water")) {
+			conf.duelist_high_water = atoi(valbuf);
+		} else if(!strcmp(strbuf, "observer_high_water")) {
+			conf.observer_high_water = atoi(valbuf);
+		} else if(!strcmp(strbuf, "replay_dir")) {
+			strcpy(conf.replay_dir, valbuf);
+		} else if(!strcmp(strbuf, "replay_compression")) {
+			conf.replay_compression = atoi(valbuf);
+		} else if(!strcmp(strbuf, "script_cache")) {
+			conf.script_cache = atoi(valbuf);
+		} else if(!strcmp(strbuf, "script_cache_file")) {
+			strcpy(conf.script_cache_file, valbuf);
+		} else if(!strcmp(strbuf, "accept_seed")) {
+			conf.accept_seed = atoi(valbuf);
+		}
+	}
+	fclose(fp);
+}
+
+int main(int argc, char* argv[]) {
+#ifndef _WIN32
+	setlocale(LC_CTYPE, "UTF-8");
+	signal(SIGPIPE, SIG_IGN);
+#endif
+#ifdef _WIN32
+	WORD wVersionRequested;
+	WSADATA wsaData;
+	wVersionRequested = MAKEWORD(2, 2);
+	WSAStartup(wVersionRequested, &wsaData);
+	evthread_use_windows_threads();
+#else
+	evthread_use_pthreads();
+#endif //_WIN32
+	ServerConfig conf;
+	conf.port = 7911;
+	conf.workers = 0;
+	conf.prefer_expansion_script = 0;
+	conf.stats_file[0] = 0;
+	conf.stats_interval = 10;
+	conf.duelist_high_water = 8192;
+	conf.observer_high_water = 1024;
+	strcpy(conf.replay_dir, "./replay/server");
+	conf.replay_compression = REPLAY_LEVEL_DEFAULT;
+	conf.script_cache = 1;
+	conf.script_cache_file[0] = 0;
+	conf.accept_seed = 0;
+	const char* conf_file = "server.conf";
+	for(int i = 1; i < argc - 1; ++i) {
+		if(!strcmp(argv[i], "-c"))
+			conf_file = argv[i + 1];
+	}
+	LoadServerConfig(conf_file, conf);
+	std::vector<const char*> extra_db;
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "-p")) { // Port
+			++i;
+			if(i < argc)
+				conf.port = atoi(argv[i]);
+		} else if(!strcmp(argv[i], "-w")) { // Worker threads
+			++i;
+			if(i < argc)
+				conf.workers = atoi(argv[i]);
+		} else if(!strcmp(argv[i], "-e")) { // extra database
+			++i;
+			if(i < argc)
+				extra_db.push_back(argv[i]);
+		} else if(!strcmp(argv[i], "-c")) {
+			++i;
+		} else if(!strcmp(argv[i], "-l")) { // Log script messages
+			enable_log = 1;
+		} else if(!strcmp(argv[i], "-s")) { // Stats file
+			++i;
+			if(i < argc) {
+				strncpy(conf.stats_file, argv[i], sizeof(conf.stats_file) - 1);
+				conf.stats_file[sizeof(conf.stats_file) - 1] = 0;
+			}
+		}
+	}
+	ygo::deckManager.LoadLFList();
+	std::vector<std::string> databases;
+	ygo::DataManager::ListDBs("./expansions", databases);
+	size_t main_db = databases.size();
+	databases.push_back("cards.cdb");
+	for(auto db : extra_db)
+		databases.push_back(db);
+	std::vector<bool> loaded = ygo::dataManager.LoadDBs(databases);
+	if(enable_log) {
+		for(auto& step : ygo::dataManager.load_times) {
+			char msgbuf[1024];
+			ygo::DataManager::FormatLoadTime(step, msgbuf, sizeof(msgbuf));
+			fprintf(stderr, "%s\n", msgbuf);
+		}
+	}
+	if(!loaded[main_db]) {
+		fprintf(stderr, "Failed to load card database (cards.cdb)!\n");
+		return EXIT_FAILURE;
+	}
+	ygo::dataManager.prefer_expansion_script = conf.prefer_expansion_script != 0;
+	if(conf.script_cache)
+		ygo::ScriptCache::Enable(conf.script_cache_file);
+	if(conf.stats_file[0])
+		ygo::NetServer::SetStatsFile(conf.stats_file, conf.stats_interval);
+	ygo::NetServer::SetHighWater((size_t)conf.duelist_high_water * 1024, (size_t)conf.observer_high_water * 1024);
+	ygo::NetServer::SetAcceptSeed(conf.accept_seed != 0);
+	ygo::ReplayWriter::SetArchive(conf.replay_dir);
+	ygo::Replay::compression_level = conf.replay_compression;
+	fprintf(stderr, "ygoserver listening on port %d, %d worker(s)\n", conf.port, conf.workers);
+	int ret = ygo::NetServer::RunServer(conf.port, conf.workers);
+	if(ret)
+		fprintf(stderr, "Failed to listen on port %d!\n", conf.port);
+#ifdef _WIN32
+	WSACleanup();
+#endif //_WIN32
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
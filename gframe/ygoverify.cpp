@@ -0,0 +1,524 @@
+#include "config.h"
+#include "data_manager.h"
+#include "replay.h"
+#include "script_cache.h"
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+int enable_log = 0;
+
+namespace ygo {
+
+enum {
+	VERIFY_FINISHED,
+	VERIFY_UNFINISHED,
+	VERIFY_DIVERGED,
+	VERIFY_ERROR,
+};
+
+static const char* verify_outcomes[] = { "finished", "unfinished", "diverged", "error" };
+
+struct VerifyResult {
+	const char* file;
+	int outcome;
+	int winner;
+	int reason;
+	int turns;
+	unsigned int messages;
+	unsigned int responses;
+	unsigned long long engine_time;
+	const char* detail;
+};
+
+class ReplayVerifier {
+public:
+	static void Run(int threads);
+	static void Summary();
+
+	static std::vector<std::string> files;
+	static unsigned int jobs;
+	static bool quiet;
+	static unsigned long long counts[4];
+	static unsigned long long total_messages;
+	static unsigned long long total_engine_time;
+	static unsigned long long start_time;
+	static unsigned long long end_time;
+
+private:
+	static void WorkerThread();
+	static void Verify(const char* file, VerifyResult& result);
+	static bool StartDuel(long pduel, Replay& replay);
+	static bool LoadCards(long pduel, Replay& replay, int player, int location, bool tag);
+	static int Analyze(long pduel, Replay& replay, VerifyResult& result, char* msg, unsigned int len);
+	static void Report(const VerifyResult& result);
+	static int MessageHandler(long fduel, int type);
+	static unsigned long long Now();
+	static unsigned long long ThreadTime();
+
+	static std::atomic<unsigned int> next_job;
+	static std::mutex duel_mutex;
+	static std::mutex report_mutex;
+};
+
+std::vector<std::string> ReplayVerifier::files;
+unsigned int ReplayVerifier::jobs = 0;
+bool ReplayVerifier::quiet = false;
+unsigned long long ReplayVerifier::counts[4] = { 0 };
+unsigned long long ReplayVerifier::total_messages = 0;
+unsigned long long ReplayVerifier::total_engine_time = 0;
+unsigned long long ReplayVerifier::start_time = 0;
+unsigned long long ReplayVerifier::end_time = 0;
+std::atomic<unsigned int> ReplayVerifier::next_job(0);
+std::mutex ReplayVerifier::duel_mutex;
+std::mutex ReplayVerifier::report_mutex;
+
+unsigned long long ReplayVerifier::Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+// cpu time of the calling thread in microseconds
+unsigned long long ReplayVerifier::ThreadTime() {
+#ifdef _WIN32
+	FILETIME create, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &create, &exit, &kernel, &user);
+	return ((((unsigned long long)user.dwHighDateTime << 32) | user.dwLowDateTime)
+		+ (((unsigned long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime)) / 10;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+int ReplayVerifier::MessageHandler(long fduel, int type) {
+	if(!enable_log)
+		return 0;
+	char msgbuf[1024];
+	get_log_message(fduel, (byte*)msgbuf);
+	fprintf(stderr, "%s\n", msgbuf);
+	return 0;
+}
+void ReplayVerifier::Run(int threads) {
+	set_script_reader((script_reader)DataManager::ScriptReaderEx);
+	set_card_reader((card_reader)DataManager::CardReader);
+	set_message_handler((message_handler)MessageHandler);
+	start_time = Now();
+	std::vector<std::thread> workers;
+	for(int i = 0; i < threads; ++i)
+		workers.push_back(std::thread(WorkerThread));
+	for(auto& t : workers)
+		t.join();
+	end_time = Now();
+}
+void ReplayVerifier::WorkerThread() {
+	while(true) {
+		unsigned int job = next_job++;
+		if(job >= jobs)
+			break;
+		VerifyResult result;
+		Verify(files[job % files.size()].c_str(), result);
+		Report(result);
+	}
+}
+void ReplayVerifier::Verify(const char* file, VerifyResult& result) {
+	result.file = file;
+	result.outcome = VERIFY_ERROR;
+	result.winner = -1;
+	result.reason = 0;
+	result.turns = 0;
+	result.messages = 0;
+	result.responses = 0;
+	result.engine_time = 0;
+	result.detail = "";
+	wchar_t wname[256];
+	BufferIO::DecodeUTF8(file, wname);
+	Replay replay;
+	if(!replay.OpenReplay(wname)) {
+		result.detail = "cannot open the replay";
+		return;
+	}
+	duel_mutex.lock();
+	long pduel = create_duel(std::mt19937(replay.pheader.seed)());
+	duel_mutex.unlock();
+	if(!StartDuel(pduel, replay)) {
+		result.detail = "bad duel setup";
+	} else {
+		char engineBuffer[0x1000];
+		unsigned int engFlag = 0, engLen = 0;
+		int stop = 0;
+		while(!stop) {
+			if(engFlag == 2) {
+				// the engine ended the duel without a winner
+				result.outcome = VERIFY_FINISHED;
+				break;
+			}
+			unsigned long long start = ThreadTime();
+			int ret = process(pduel);
+			result.engine_time += ThreadTime() - start;
+			engLen = ret & 0xffff;
+			engFlag = ret >> 16;
+			if(engLen > 0) {
+				get_message(pduel, (byte*)engineBuffer);
+				stop = Analyze(pduel, replay, result, engineBuffer, engLen);
+			}
+		}
+	}
+	duel_mutex.lock();
+	end_duel(pduel);
+	duel_mutex.unlock();
+}
+bool ReplayVerifier::LoadCards(long pduel, Replay& replay, int player, int location, bool tag) {
+	int count = replay.ReadInt32();
+	if(count < 0 || count > 1024)
+		return false;
+	for(int i = 0; i < count; ++i) {
+		if(tag)
+			new_tag_card(pduel, replay.ReadInt32(), player, location);
+		else
+			new_card(pduel, replay.ReadInt32(), player, player, location, 0, POS_FACEDOWN_DEFENSE);
+	}
+	return true;
+}
+// same setup as ReplayMode::StartDuel
+bool ReplayVerifier::StartDuel(long pduel, Replay& replay) {
+	const ReplayHeader& rh = replay.pheader;
+	wchar_t name[20];
+	int names = (rh.flag & REPLAY_TAG) ? 4 : 2;
+	for(int i = 0; i < names; ++i)
+		replay.ReadName(name);
+	int start_lp = replay.ReadInt32();
+	int start_hand = replay.ReadInt32();
+	int draw_count = replay.ReadInt32();
+	int opt = replay.ReadInt32();
+	set_player_info(pduel, 0, start_lp, start_hand, draw_count);
+	set_player_info(pduel, 1, start_lp, start_hand, draw_count);
+	if(!(rh.flag & REPLAY_SINGLE_MODE)) {
+		bool tag = !!(opt & DUEL_TAG_MODE);
+		for(int p = 0; p < 2; ++p) {
+			if(!LoadCards(pduel, replay, p, LOCATION_DECK, false) || !LoadCards(pduel, replay, p, LOCATION_EXTRA, false))
+				return false;
+			if(tag && (!LoadCards(pduel, replay, p, LOCATION_DECK, true) || !LoadCards(pduel, replay, p, LOCATION_EXTRA, true)))
+				return false;
+		}
+	} else {
+		char filename[256];
+		int slen = replay.ReadInt16();
+		if(slen < 0 || slen > 255)
+			return false;
+		replay.ReadData(filename, slen);
+		filename[slen] = 0;
+		if(!preload_script(pduel, filename, 0))
+			return false;
+	}
+	if(!(rh.flag & REPLAY_UNIFORM))
+		opt |= DUEL_OLD_REPLAY;
+	start_duel(pduel, opt);
+	return true;
+}
+// walks a batch of engine messages like ReplayMode::ReplayAnalyze, returns non-zero when the duel is over
+int ReplayVerifier::Analyze(long pduel, Replay& replay, VerifyResult& result, char* msg, unsigned int len) {
+	char* pbuf = msg;
+	int count;
+	unsigned char resp[64];
+	while(pbuf - msg < (int)len) {
+		result.messages++;
+		unsigned char curMsg = BufferIO::ReadUInt8(pbuf);
+		switch(curMsg) {
+		case MSG_RETRY: {
+			result.outcome = VERIFY_DIVERGED;
+			result.detail = "the engine rejected a recorded response";
+			return 1;
+		}
+		case MSG_WIN: {
+			result.winner = BufferIO::ReadUInt8(pbuf);
+			result.reason = BufferIO::ReadUInt8(pbuf);
+			if(replay.ReadNextResponse(resp)) {
+				result.outcome = VERIFY_DIVERGED;
+				result.detail = "the duel ended before the recording";
+			} else
+				result.outcome = VERIFY_FINISHED;
+			return 1;
+		}
+		case MSG_SELECT_BATTLECMD:
+		case MSG_SELECT_IDLECMD:
+		case MSG_SELECT_EFFECTYN:
+		case MSG_SELECT_YESNO:
+		case MSG_SELECT_OPTION:
+		case MSG_SELECT_CARD:
+		case MSG_SELECT_TRIBUTE:
+		case MSG_SELECT_UNSELECT_CARD:
+		case MSG_SELECT_CHAIN:
+		case MSG_SELECT_PLACE:
+		case MSG_SELECT_DISFIELD:
+		case MSG_SELECT_POSITION:
+		case MSG_SELECT_COUNTER:
+		case MSG_SELECT_SUM:
+		case MSG_SORT_CARD:
+		case MSG_ROCK_PAPER_SCISSORS:
+		case MSG_ANNOUNCE_RACE:
+		case MSG_ANNOUNCE_ATTRIB:
+		case MSG_ANNOUNCE_CARD:
+		case MSG_ANNOUNCE_NUMBER: {
+			// a selection is always the last message of its batch
+			if(!replay.ReadNextResponse(resp)) {
+				// the recording stops here, the duel was surrendered or abandoned
+				result.outcome = VERIFY_UNFINISHED;
+				return 1;
+			}
+			set_responseb(pduel, resp);
+			result.responses++;
+			return 0;
+		}
+		case MSG_CONFIRM_DECKTOP:
+		case MSG_CONFIRM_EXTRATOP:
+		case MSG_CONFIRM_CARDS: {
+			pbuf++;
+			count = BufferIO::ReadInt8(pbuf);
+			pbuf += count * 7;
+			break;
+		}
+		case MSG_SHUFFLE_HAND:
+		case MSG_SHUFFLE_EXTRA:
+		case MSG_CARD_SELECTED:
+		case MSG_RANDOM_SELECTED:
+		case MSG_DRAW: {
+			pbuf++;
+			count = BufferIO::ReadInt8(pbuf);
+			pbuf += count * 4;
+			break;
+		}
+		case MSG_BECOME_TARGET: {
+			count = BufferIO::ReadInt8(pbuf);
+			pbuf += count * 4;
+			break;
+		}
+		case MSG_SHUFFLE_SET_CARD: {
+			pbuf++;
+			count = BufferIO::ReadInt8(pbuf);
+			pbuf += count * 8;
+			break;
+		}
+		case MSG_TOSS_COIN:
+		case MSG_TOSS_DICE: {
+			pbuf++;
+			count = BufferIO::ReadInt8(pbuf);
+			pbuf += count;
+			break;
+		}
+		case MSG_NEW_TURN: {
+			result.turns++;
+			pbuf++;
+			break;
+		}
+		case MSG_REVERSE_DECK:
+		case MSG_SUMMONED:
+		case MSG_SPSUMMONED:
+		case MSG_FLIPSUMMONED:
+		case MSG_CHAIN_END:
+		case MSG_ATTACK_DISABLED:
+		case MSG_DAMAGE_STEP_START:
+		case MSG_DAMAGE_STEP_END: {
+			break;
+		}
+		case MSG_SHUFFLE_DECK:
+		case MSG_REFRESH_DECK:
+		case MSG_SWAP_GRAVE_DECK:
+		case MSG_CHAINED:
+		case MSG_CHAIN_SOLVING:
+		case MSG_CHAIN_SOLVED:
+		case MSG_CHAIN_NEGATED:
+		case MSG_CHAIN_DISABLED:
+		case MSG_HAND_RES: {
+			pbuf++;
+			break;
+		}
+		case MSG_NEW_PHASE: {
+			pbuf += 2;
+			break;
+		}
+		case MSG_FIELD_DISABLED:
+		case MSG_UNEQUIP:
+		case MSG_MATCH_KILL: {
+			pbuf += 4;
+			break;
+		}
+		case MSG_DAMAGE:
+		case MSG_RECOVER:
+		case MSG_LPUPDATE:
+		case MSG_PAY_LPCOST: {
+			pbuf += 5;
+			break;
+		}
+		case MSG_HINT:
+		case MSG_DECK_TOP:
+		case MSG_PLAYER_HINT: {
+			pbuf += 6;
+			break;
+		}
+		case MSG_ADD_COUNTER:
+		case MSG_REMOVE_COUNTER: {
+			pbuf += 7;
+			break;
+		}
+		case MSG_SET:
+		case MSG_SUMMONING:
+		case MSG_SPSUMMONING:
+		case MSG_FLIPSUMMONING:
+		case MSG_EQUIP:
+		case MSG_CARD_TARGET:
+		case MSG_CANCEL_TARGET:
+		case MSG_ATTACK:
+		case MSG_MISSED_EFFECT: {
+			pbuf += 8;
+			break;
+		}
+		case MSG_POS_CHANGE:
+		case MSG_CARD_HINT: {
+			pbuf += 9;
+			break;
+		}
+		case MSG_MOVE:
+		case MSG_SWAP:
+		case MSG_CHAINING: {
+			pbuf += 16;
+			break;
+		}
+		case MSG_BATTLE: {
+			pbuf += 26;
+			break;
+		}
+		case MSG_TAG_SWAP: {
+			pbuf += pbuf[2] * 4 + pbuf[4] * 4 + 9;
+			break;
+		}
+		case MSG_RELOAD_FIELD: {
+			pbuf++;
+			for(int p = 0; p < 2; ++p) {
+				pbuf += 4;
+				for(int seq = 0; seq < 7; ++seq) {
+					int val = BufferIO::ReadInt8(pbuf);
+					if(val)
+						pbuf += 2;
+				}
+				for(int seq = 0; seq < 8; ++seq) {
+					int val = BufferIO::ReadInt8(pbuf);
+					if(val)
+						pbuf++;
+				}
+				pbuf += 6;
+			}
+			pbuf++;
+			break;
+		}
+		case MSG_AI_NAME:
+		case MSG_SHOW_HINT: {
+			int len = BufferIO::ReadInt16(pbuf);
+			pbuf += len + 1;
+			break;
+		}
+		default: {
+			// without its length the rest of the batch cannot be read
+			result.detail = "unknown engine message";
+			return 1;
+		}
+		}
+	}
+	return 0;
+}
+void ReplayVerifier::Report(const VerifyResult& result) {
+	std::lock_guard<std::mutex> lock(report_mutex);
+	counts[result.outcome]++;
+	total_messages += result.messages;
+	total_engine_time += result.engine_time;
+	if(quiet && result.outcome != VERIFY_DIVERGED && result.outcome != VERIFY_ERROR)
+		return;
+	// file outcome winner reason turns messages responses engine_ms detail, tab separated
+	fprintf(stdout, "%s\t%s\t%d\t%d\t%d\t%u\t%u\t%.3f\t%s\n", result.file, verify_outcomes[result.outcome], result.winner,
+		result.reason, result.turns, result.messages, result.responses, result.engine_time / 1000.0, result.detail);
+	fflush(stdout);
+}
+void ReplayVerifier::Summary() {
+	double elapsed = (end_time - start_time) / 1000000.0;
+	if(elapsed <= 0)
+		elapsed = 1e-6;
+	unsigned long long duels = counts[VERIFY_FINISHED] + counts[VERIFY_UNFINISHED] + counts[VERIFY_DIVERGED] + counts[VERIFY_ERROR];
+	fprintf(stdout, "total: %llu duels in %.2fs, %.1f duels/s, %.0f msgs/s, engine %.2fs, %llu finished, %llu unfinished, %llu diverged, %llu errors\n",
+		duels, elapsed, duels / elapsed, total_messages / elapsed, total_engine_time / 1000000.0,
+		counts[VERIFY_FINISHED], counts[VERIFY_UNFINISHED], counts[VERIFY_DIVERGED], counts[VERIFY_ERROR]);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+#ifndef _WIN32
+	setlocale(LC_CTYPE, "UTF-8");
+#endif
+	int threads = std::thread::hardware_concurrency();
+	int passes = 1;
+	std::vector<const char*> extra_db;
+	std::vector<const char*> paths;
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "-w") && i + 1 < argc) { // Worker threads
+			threads = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-n") && i + 1 < argc) { // Passes over the replays
+			passes = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-e") && i + 1 < argc) { // Extra database
+			extra_db.push_back(argv[++i]);
+		} else if(!strcmp(argv[i], "-q")) { // Only list diverged replays and errors
+			ygo::ReplayVerifier::quiet = true;
+		} else if(!strcmp(argv[i], "-l")) { // Log script messages
+			enable_log = 1;
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+	for(auto path : paths) {
+		if(FileSystem::IsDirExists(path)) {
+			FileSystem::TraversalDir(path, [path](const char* name, bool isdir) {
+				// the whole extension, journals (.yrpj) and seek indexes (.yrpi) are skipped
+				if(!isdir && strrchr(name, '.') && !mystrncasecmp(strrchr(name, '.'), ".yrp", 5)) {
+					char fpath[1024];
+					sprintf(fpath, "%s/%s", path, name);
+					ygo::ReplayVerifier::files.push_back(fpath);
+				}
+			});
+		} else
+			ygo::ReplayVerifier::files.push_back(path);
+	}
+	if(ygo::ReplayVerifier::files.empty()) {
+		fprintf(stderr, "Usage: ygoverify [-w threads] [-n passes] [-e extra.cdb] [-q] [-l] replay.yrp|dir ...\n");
+		return EXIT_FAILURE;
+	}
+	std::vector<std::string> databases;
+	ygo::DataManager::ListDBs("./expansions", databases);
+	size_t main_db = databases.size();
+	databases.push_back("cards.cdb");
+	for(auto db : extra_db)
+		databases.push_back(db);
+	std::vector<bool> loaded = ygo::dataManager.LoadDBs(databases);
+	if(enable_log) {
+		for(auto& step : ygo::dataManager.load_times) {
+			char msgbuf[1024];
+			ygo::DataManager::FormatLoadTime(step, msgbuf, sizeof(msgbuf));
+			fprintf(stderr, "%s\n", msgbuf);
+		}
+	}
+	if(!loaded[main_db]) {
+		fprintf(stderr, "Failed to load card database (cards.cdb)!\n");
+		return EXIT_FAILURE;
+	}
+	// every replay loads the same scripts, they are compiled once for the whole run
+	ygo::ScriptCache::Enable(0);
+	if(threads < 1)
+		threads = 1;
+	if(passes < 1)
+		passes = 1;
+	std::sort(ygo::ReplayVerifier::files.begin(), ygo::ReplayVerifier::files.end());
+	ygo::ReplayVerifier::jobs = (unsigned int)ygo::ReplayVerifier::files.size() * passes;
+	fprintf(stderr, "%d replays, %d pass(es) on %d thread(s)\n", (int)ygo::ReplayVerifier::files.size(), passes, threads);
+	ygo::ReplayVerifier::Run(threads);
+	ygo::ReplayVerifier::Summary();
+	const unsigned long long* counts = ygo::ReplayVerifier::counts;
+	return (counts[ygo::VERIFY_DIVERGED] || counts[ygo::VERIFY_ERROR]) ? EXIT_FAILURE : EXIT_SUCCESS;
+}